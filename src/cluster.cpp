@@ -0,0 +1,785 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "cluster.h"
+#include "misc.h"
+#include "timeman.h"
+#include "tt.h"
+#include "uci.h"
+
+namespace Stockfish::Cluster {
+
+std::atomic<int> ShareDepth { MAX_PLY };
+
+#if defined(_WIN32)
+
+void init(const std::string& workers) {
+
+  if (!workers.empty() && workers != "<empty>")
+      sync_cout << "info string Cluster mode is not supported on this system" << sync_endl;
+}
+
+void exit() {}
+void set_min_depth(int) {}
+void forward(const std::string&) {}
+void forward_option(const std::string&, const std::string&) {}
+
+bool serve(int, char*[]) {
+
+  sync_cout << "info string Cluster mode is not supported on this system" << sync_endl;
+  return false;
+}
+
+std::string next_command() { return "quit"; }
+void start_search() {}
+std::vector<ThreadPool::Vote> finish_search() { return {}; }
+void save(Key, Value, bool, Bound, Depth, Move, Value) {}
+
+#else
+
+namespace {
+
+  // A message is a Header followed by 'size' bytes of payload: the text of a
+  // UCI command, an array of Entry, the id of a search, or a ResultHeader
+  // followed by an array of votes.
+  enum MessageType : uint32_t { Command, Entries, Go, Result };
+
+  struct Header {
+    uint32_t type, size;
+  };
+
+  struct ResultHeader {
+    uint64_t id, nodes;
+  };
+
+  // Entry is a TT entry as sent to the other processes, with the value already
+  // adjusted for the TT. The bound is in the low 2 bits of 'bound', the PV flag
+  // in bit 2, as in TTEntry::genBound8.
+  struct Entry {
+    Key key;
+    int16_t value, eval;
+    uint16_t move;
+    uint8_t depth, bound;
+  };
+
+  static_assert(sizeof(Entry) == 16, "Unexpected Entry size");
+
+  constexpr size_t MaxBatch = 4096;       // Entries per message
+  constexpr size_t MaxOutbox = 65536;     // Entries waiting to be sent, newer ones are dropped
+  constexpr uint32_t MaxMessage = 1 << 24;
+  constexpr int PollMs = 10;              // Longest wait of an entry before it is sent
+  constexpr int ResultTimeoutMs = 2000;   // Longest wait for the votes without time management
+  constexpr int MinResultWaitMs = 5;
+
+  struct Peer {
+    int fd = -1;
+    std::string address;
+    std::string in;                       // Received bytes of incomplete messages
+    std::mutex sendMutex;
+    std::atomic_bool closed { true };
+    bool awaiting = false;                // Master: the result of the search is due
+  };
+
+  std::vector<std::unique_ptr<Peer>> peers; // The workers, or the master of a worker
+  bool isWorker = false;
+  int listenFd = -1;
+  int minDepth = 8;
+
+  std::thread io;
+  std::atomic_bool ioExit { false };
+
+  std::mutex mutex; // Protects what follows
+  std::condition_variable cv;
+  std::vector<Entry> outbox;
+  std::deque<std::pair<std::string, uint64_t>> commands; // Worker: UCI commands and their search id
+  uint64_t goId = 0, searchId = 0;
+  bool searching = false;
+  size_t pending = 0;
+  uint64_t remoteNodes = 0;
+  std::vector<ThreadPool::Vote> results;
+
+  // Master: the last setoption of each forwarded option, sent again to the
+  // workers on connection.
+  std::map<std::string, std::string, UCI::CaseInsensitiveLess> optionCommands;
+
+  // The options a worker keeps for itself: its threads and memory, set when
+  // it is started, its statistics, books and experience, and the cluster.
+  bool is_local_option(const std::string& name) {
+
+    static const char* Local[] = { "Debug Log File", "Threads", "Spin Wait", "Thread Placement",
+                                   "Perf Counters", "Cluster Workers", "Cluster Min Depth", "Hash",
+                                   "Memory Budget", "Memory Policy", "Stats File", "Stats Format",
+                                   "Stats Interval" };
+
+    auto equal = [](const std::string& a, const std::string& b) {
+        return !UCI::CaseInsensitiveLess()(a, b) && !UCI::CaseInsensitiveLess()(b, a);
+    };
+
+    for (const char* l : Local)
+        if (equal(name, l))
+            return true;
+
+    return equal(name.substr(0, 4), "Book") || equal(name.substr(0, 10), "Experience");
+  }
+
+
+  // open_socket() returns a socket connected to the given address, or listening
+  // on it, or -1. A TCP address without host listens on all the interfaces.
+
+  int open_socket(const std::string& address, bool listening) {
+
+    int one = 1;
+
+    if (address.rfind("unix:", 0) == 0)
+    {
+        sockaddr_un sa;
+        std::string path = address.substr(5);
+
+        if (path.empty() || path.size() >= sizeof(sa.sun_path))
+            return -1;
+
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        std::strcpy(sa.sun_path, path.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+
+        if (listening)
+            unlink(path.c_str());
+
+        if (listening ? bind(fd, (sockaddr*)&sa, sizeof(sa)) == 0 && listen(fd, 4) == 0
+                      : connect(fd, (sockaddr*)&sa, sizeof(sa)) == 0)
+            return fd;
+
+        close(fd);
+        return -1;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return -1;
+
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+    addrinfo hints, *res;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res))
+        return -1;
+
+    int fd = -1;
+    for (addrinfo* ai = res; ai && fd == -1; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (!(listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 4) == 0
+                        : connect(fd, ai->ai_addr, ai->ai_addrlen) == 0))
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    freeaddrinfo(res);
+    return fd;
+  }
+
+
+  // send_message() sends a whole message, or marks the peer as closed
+
+  void send_message(Peer& p, MessageType type, const void* data, size_t size) {
+
+    std::lock_guard<std::mutex> lk(p.sendMutex);
+
+    if (p.closed)
+        return;
+
+    Header h = { uint32_t(type), uint32_t(size) };
+    const char* parts[] = { (const char*)&h, (const char*)data };
+    size_t sizes[] = { sizeof(h), size };
+
+    for (int i = 0; i < 2; ++i)
+        for (size_t sent = 0; sent < sizes[i]; )
+        {
+            ssize_t n = send(p.fd, parts[i] + sent, sizes[i] - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                p.closed = true;
+                return;
+            }
+            sent += size_t(n);
+        }
+  }
+
+  void send_command(const std::string& cmd) {
+
+    for (auto& p : peers)
+        send_message(*p, Command, cmd.data(), cmd.size());
+  }
+
+
+  // apply() stores the received entries in the TT, unless it already holds a
+  // deeper search of the same position.
+
+  void apply(const std::string& payload) {
+
+    std::unique_lock<std::mutex> lk(TT.resizeMutex, std::try_to_lock);
+    if (!lk.owns_lock())
+        return; // The table is being reallocated
+
+    for (size_t i = 0; i + sizeof(Entry) <= payload.size(); i += sizeof(Entry))
+    {
+        Entry e;
+        std::memcpy(&e, payload.data() + i, sizeof(e));
+
+        bool found;
+        TTEntry* tte = TT.probe(e.key, found);
+
+        if (!found || tte->depth() < e.depth)
+            tte->save(e.key, Value(e.value), e.bound >> 2, Bound(e.bound & 3),
+                      Depth(e.depth), Move(e.move), Value(e.eval));
+    }
+  }
+
+
+  void handle(Peer& from, uint32_t type, const std::string& payload) {
+
+    if (type == Entries)
+    {
+        apply(payload);
+
+        // The master relays the entries of each worker to the other workers
+        if (!isWorker)
+            for (auto& p : peers)
+                if (p.get() != &from)
+                    send_message(*p, Entries, payload.data(), payload.size());
+    }
+    else if (type == Command || (type == Go && payload.size() == sizeof(uint64_t)))
+    {
+        uint64_t id = 0;
+        if (type == Go)
+            std::memcpy(&id, payload.data(), sizeof(id));
+
+        std::lock_guard<std::mutex> lk(mutex);
+        commands.emplace_back(type == Go ? "go infinite" : payload, id);
+        cv.notify_all();
+    }
+    else if (type == Result && payload.size() >= sizeof(ResultHeader))
+    {
+        ResultHeader rh;
+        std::memcpy(&rh, payload.data(), sizeof(rh));
+
+        std::lock_guard<std::mutex> lk(mutex);
+
+        if (rh.id != searchId || !from.awaiting)
+            return; // Late answer to an earlier search
+
+        for (size_t i = sizeof(rh); i + sizeof(ThreadPool::Vote) <= payload.size(); i += sizeof(ThreadPool::Vote))
+        {
+            results.emplace_back();
+            std::memcpy(&results.back(), payload.data() + i, sizeof(ThreadPool::Vote));
+        }
+
+        remoteNodes += rh.nodes;
+        from.awaiting = false;
+        --pending;
+        cv.notify_all();
+    }
+  }
+
+
+  void disconnect(Peer& p) {
+
+    {
+        std::lock_guard<std::mutex> lk(p.sendMutex);
+        p.closed = true;
+        close(p.fd);
+        p.fd = -1;
+        p.in.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+
+        if (isWorker)
+            commands.emplace_back("stop", 0); // Nobody waits for this search any more
+
+        else if (p.awaiting)
+        {
+            p.awaiting = false;
+            --pending;
+        }
+
+        cv.notify_all();
+    }
+
+    sync_cout << "info string Cluster: " << (isWorker ? "master" : p.address) << " disconnected" << sync_endl;
+  }
+
+
+  void receive(Peer& p) {
+
+    char buf[65536];
+    ssize_t n = recv(p.fd, buf, sizeof(buf), 0);
+
+    if (n <= 0)
+    {
+        disconnect(p);
+        return;
+    }
+
+    p.in.append(buf, size_t(n));
+
+    Header h;
+    while (p.in.size() >= sizeof(h))
+    {
+        std::memcpy(&h, p.in.data(), sizeof(h));
+
+        if (h.size > MaxMessage)
+        {
+            disconnect(p);
+            return;
+        }
+
+        if (p.in.size() < sizeof(h) + h.size)
+            break;
+
+        std::string payload = p.in.substr(sizeof(h), h.size);
+        p.in.erase(0, sizeof(h) + h.size);
+        handle(p, h.type, payload);
+    }
+  }
+
+
+  // A worker serves one master at a time. It keeps listening, so that a new
+  // master can take over once the previous one has gone.
+
+  void accept_master() {
+
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd == -1)
+        return;
+
+    Peer& p = *peers[0];
+
+    if (!p.closed)
+    {
+        close(fd);
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    {
+        std::lock_guard<std::mutex> lk(p.sendMutex);
+        p.fd = fd;
+        p.closed = false;
+    }
+
+    sync_cout << "info string Cluster: master connected" << sync_endl;
+  }
+
+
+  // io_loop() runs in its own thread. It receives the messages of the peers
+  // and sends the entries saved by the search since the previous round.
+
+  void io_loop() {
+
+    std::vector<pollfd> fds;
+    std::vector<Entry> batch;
+
+    while (!ioExit)
+    {
+        fds.clear();
+        for (auto& p : peers)
+            fds.push_back({ p->closed ? -1 : p->fd, POLLIN, 0 });
+
+        if (isWorker)
+            fds.push_back({ listenFd, POLLIN, 0 });
+
+        if (poll(fds.data(), fds.size(), PollMs) > 0)
+        {
+            for (size_t i = 0; i < peers.size(); ++i)
+                if (fds[i].revents)
+                    receive(*peers[i]);
+
+            if (isWorker && fds.back().revents)
+                accept_master();
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            batch.swap(outbox);
+        }
+
+        for (size_t i = 0; i < batch.size(); i += MaxBatch)
+            for (auto& p : peers)
+                send_message(*p, Entries, &batch[i], std::min(MaxBatch, batch.size() - i) * sizeof(Entry));
+
+        batch.clear();
+    }
+  }
+
+  void start_io() {
+
+    ShareDepth = minDepth;
+    ioExit = false;
+    io = std::thread(io_loop);
+  }
+
+  void stop_io() {
+
+    ShareDepth = MAX_PLY;
+
+    if (io.joinable())
+    {
+        ioExit = true;
+        io.join();
+    }
+  }
+
+  void close_all() {
+
+    for (auto& p : peers)
+        if (p->fd != -1)
+            close(p->fd);
+
+    if (listenFd != -1)
+        close(listenFd);
+
+    peers.clear();
+    listenFd = -1;
+    isWorker = false;
+
+    std::lock_guard<std::mutex> lk(mutex);
+    outbox.clear();
+    commands.clear();
+    searching = false;
+    pending = 0;
+  }
+
+} // namespace
+
+
+/// Cluster::init() connects to the workers, given as a comma separated list
+/// of addresses, after closing the connections to the previous ones.
+
+void init(const std::string& workers) {
+
+  // The previous workers stay up, waiting for a new master
+  stop_io();
+  close_all();
+
+  if (workers.empty() || workers == "<empty>")
+      return;
+
+  std::string address;
+  std::istringstream ss(workers);
+
+  while (std::getline(ss, address, ','))
+  {
+      address.erase(std::remove(address.begin(), address.end(), ' '), address.end());
+
+      int fd = open_socket(address, false);
+      if (fd == -1)
+      {
+          sync_cout << "info string Cluster: cannot connect to " << address << sync_endl;
+          continue;
+      }
+
+      peers.push_back(std::make_unique<Peer>());
+      peers.back()->fd = fd;
+      peers.back()->address = address;
+      peers.back()->closed = false;
+  }
+
+  sync_cout << "info string Cluster: connected to " << peers.size() << " worker(s)" << sync_endl;
+
+  if (peers.empty())
+      return;
+
+  send_command("setoption name Cluster Min Depth value " + std::to_string(minDepth));
+
+  for (const auto& oc : optionCommands)
+      send_command(oc.second);
+
+  start_io();
+}
+
+
+/// Cluster::exit() closes the connections, and the workers of a master quit
+
+void exit() {
+
+  stop_io();
+
+  if (!isWorker)
+      send_command("quit");
+
+  close_all();
+}
+
+
+/// Cluster::set_min_depth() is called when 'Cluster Min Depth' changes. The
+/// master passes the value on to its workers.
+
+void set_min_depth(int depth) {
+
+  minDepth = depth;
+
+  if (!peers.empty())
+      ShareDepth = minDepth;
+
+  if (!isWorker)
+      send_command("setoption name Cluster Min Depth value " + std::to_string(minDepth));
+}
+
+
+/// Cluster::forward() sends a UCI command of the master to the workers
+
+void forward(const std::string& cmd) {
+
+  if (!isWorker)
+      send_command(cmd);
+}
+
+
+/// Cluster::forward_option() sends an option set on the master to the workers,
+/// unless it is local to each process. Buttons have no value and are not
+/// sent again to the workers that connect later.
+
+void forward_option(const std::string& name, const std::string& value) {
+
+  if (isWorker || is_local_option(name))
+      return;
+
+  std::string cmd = "setoption name " + name + (value.empty() ? "" : " value " + value);
+
+  if (!value.empty())
+      optionCommands[name] = cmd;
+
+  send_command(cmd);
+}
+
+
+/// Cluster::serve() turns the process into a worker listening on the address
+/// of 'cluster <address> [threads] [hash]'. The books of the worker are off and
+/// its experience file is read-only, the master deciding about both.
+
+bool serve(int argc, char* argv[]) {
+
+  std::string address = argv[0];
+
+  if (argc > 1)
+      Options["Threads"] = std::string(argv[1]);
+  if (argc > 2)
+      Options["Hash"] = std::string(argv[2]);
+
+  Options["Book1"] = std::string("false");
+  Options["Book2"] = std::string("false");
+  Options["Experience Book"] = std::string("false");
+  Options["Experience Readonly"] = std::string("true");
+
+  listenFd = open_socket(address, true);
+  if (listenFd == -1)
+  {
+      sync_cout << "info string Cluster: cannot listen on " << address << sync_endl;
+      return false;
+  }
+
+  sync_cout << "info string Cluster worker listening on " << address << sync_endl;
+
+  isWorker = true;
+  peers.push_back(std::make_unique<Peer>());
+  peers.back()->address = address;
+  start_io();
+
+  return true;
+}
+
+
+/// Cluster::next_command() waits for the next command of the master
+
+std::string next_command() {
+
+  std::unique_lock<std::mutex> lk(mutex);
+  cv.wait(lk, [] { return !commands.empty(); });
+
+  std::string cmd = commands.front().first;
+  if (commands.front().second)
+      goId = commands.front().second;
+
+  commands.pop_front();
+  return cmd;
+}
+
+
+/// Cluster::start_search() is called by the main thread when a search starts.
+/// The master lets the workers search the same position.
+
+void start_search() {
+
+  std::unique_lock<std::mutex> lk(mutex);
+
+  if (isWorker)
+  {
+      searchId = goId;
+      return;
+  }
+
+  if (peers.empty())
+      return;
+
+  ++searchId;
+  searching = true;
+  pending = 0;
+  remoteNodes = 0;
+  results.clear();
+
+  for (auto& p : peers)
+  {
+      p->awaiting = !p->closed;
+      pending += p->awaiting;
+  }
+
+  uint64_t id = searchId;
+  lk.unlock();
+
+  for (auto& p : peers)
+      send_message(*p, Go, &id, sizeof(id));
+}
+
+
+/// Cluster::finish_search() is called by the main thread when the threads of
+/// the search have stopped. A worker sends the votes of its threads, while the
+/// master stops the workers and returns the votes they send.
+
+std::vector<ThreadPool::Vote> finish_search() {
+
+  if (isWorker)
+  {
+      std::vector<ThreadPool::Vote> votes = Threads.votes();
+      ResultHeader rh;
+
+      {
+          std::lock_guard<std::mutex> lk(mutex);
+          rh = { searchId, Threads.nodes_searched() };
+      }
+
+      std::string payload((const char*)&rh, sizeof(rh));
+      payload.append((const char*)votes.data(), votes.size() * sizeof(ThreadPool::Vote));
+      send_message(*peers[0], Result, payload.data(), payload.size());
+
+      return {};
+  }
+
+  std::unique_lock<std::mutex> lk(mutex);
+
+  if (!searching)
+      return {};
+
+  searching = false;
+  lk.unlock();
+
+  send_command("stop");
+
+  // Under a clock the votes of a slow worker are not worth flagging for, so we
+  // wait a small fraction of the move time and go on with the votes we have.
+  int waitMs = ResultTimeoutMs;
+
+  if (Search::Limits.use_time_management())
+      waitMs = std::clamp(int(Time.optimum() / 32), MinResultWaitMs, waitMs);
+  else if (Search::Limits.movetime)
+      waitMs = std::clamp(int(Search::Limits.movetime / 32), MinResultWaitMs, waitMs);
+
+  lk.lock();
+  cv.wait_for(lk, std::chrono::milliseconds(waitMs), [] { return pending == 0; });
+
+  std::vector<ThreadPool::Vote> votes = results;
+  uint64_t nodes = remoteNodes;
+  size_t late = pending;
+  lk.unlock();
+
+  // A worker whose position differs from ours, for instance after a failed
+  // setoption, votes for moves we cannot play. Such votes do not count.
+  const Search::RootMoves& rootMoves = Threads.main()->rootMoves;
+  size_t received = votes.size();
+
+  votes.erase(std::remove_if(votes.begin(), votes.end(), [&](const ThreadPool::Vote& v) {
+                  return std::find(rootMoves.begin(), rootMoves.end(), v.move) == rootMoves.end();
+              }), votes.end());
+
+  sync_cout << "info string Cluster: " << votes.size() << " votes";
+
+  if (votes.size() != received)
+      std::cout << " (" << received - votes.size() << " for another position dropped)";
+
+  if (late)
+      std::cout << " (" << late << (late > 1 ? " workers" : " worker") << " too late)";
+
+  std::cout << ", " << nodes << " nodes from the workers" << sync_endl;
+
+  return votes;
+}
+
+
+/// Cluster::save() queues a TT entry for the other processes
+
+void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+
+  std::lock_guard<std::mutex> lk(mutex);
+
+  if (outbox.size() < MaxOutbox)
+      outbox.push_back({ k, int16_t(v), int16_t(ev), uint16_t(m), uint8_t(d), uint8_t(b | pv << 2) });
+}
+
+#endif
+
+} // namespace Stockfish::Cluster
@@ -0,0 +1,63 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLUSTER_H_INCLUDED
+#define CLUSTER_H_INCLUDED
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "thread.h"
+
+namespace Stockfish::Cluster {
+
+/// Cluster lets several SugaR processes search the same position. The process
+/// driven by the GUI is the master and connects to the workers listed in the
+/// 'Cluster Workers' option, each started with 'sugar cluster <address>'. The
+/// master forwards its positions to the workers, which search them with their
+/// own thread pool until the master stops. Meanwhile the processes exchange
+/// the TT entries of at least 'Cluster Min Depth' in batches, the master
+/// relaying those of each worker to the others. At the end every worker sends
+/// the votes of its threads, and the master picks the best move with the same
+/// vote as ThreadPool::get_best_thread() over the threads of all processes.
+/// The options the master receives are passed on to the workers, except those
+/// about the resources of the process itself, its books and its experience.
+/// An address is "host:port" for TCP or "unix:<path>" for a Unix socket, and
+/// all the processes must run the same build.
+
+extern std::atomic<int> ShareDepth; // Minimum depth of the shared entries, or MAX_PLY when alone
+
+void init(const std::string& workers);
+void exit();
+void set_min_depth(int depth);
+void forward(const std::string& cmd);
+void forward_option(const std::string& name, const std::string& value);
+
+bool serve(int argc, char* argv[]);
+std::string next_command();
+
+void start_search();
+std::vector<ThreadPool::Vote> finish_search();
+void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+
+inline bool shares(Depth d) { return d >= ShareDepth.load(std::memory_order_relaxed); }
+
+} // namespace Stockfish::Cluster
+
+#endif // #ifndef CLUSTER_H_INCLUDED
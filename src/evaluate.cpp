@@ -55,6 +55,14 @@
   const unsigned int         gEmbeddedNNUESize = 1;
 #endif
 
+// The same for the small network, only when the build names one
+#if !defined(_MSC_VER) && defined(EVALFILE_SMALL)
+  INCBIN(EmbeddedNNUESmall, EvalFileSmallDefaultName);
+#else
+  const unsigned char        gEmbeddedNNUESmallData[1] = {0x0};
+  const unsigned int         gEmbeddedNNUESmallSize = 1;
+#endif
+
 
 using namespace std;
 
@@ -64,7 +72,9 @@ namespace Eval {
 
   bool useNNUE;
   bool useClassical;
+  bool useHybridCache;
   string eval_file_loaded = "None";
+  string eval_file_small_loaded = "None";
 
   /// NNUE::init() tries to load a NNUE network at startup time, or when the engine
   /// receives a UCI command "setoption name EvalFile value nn-[a-z0-9]{12}.nnue"
@@ -81,11 +91,9 @@ namespace Eval {
         return;
 
     string eval_file = string(Options["EvalFile"]);
+    string eval_file_small = string(Options["EvalFileSmall"]);
 
-    if (eval_file_loaded == eval_file)
-        return;
-
-#if !defined(NNUE_EMBEDDING_OFF)
+#if !defined(NNUE_EMBEDDING_OFF) || defined(EVALFILE_SMALL)
     #if defined(DEFAULT_NNUE_DIRECTORY)
     #define stringify2(x) #x
     #define stringify(x) stringify2(x)
@@ -97,6 +105,11 @@ namespace Eval {
     vector<string> dirs = { "" };
 #endif
 
+    // C++ way to prepare a buffer for a memory stream
+    class MemoryBuffer : public basic_streambuf<char> {
+        public: MemoryBuffer(char* p, size_t n) { setg(p, p, p + n); setp(p, p + n); }
+    };
+
     for (string directory : dirs)
         if (eval_file_loaded != eval_file)
         {
@@ -109,11 +122,6 @@ namespace Eval {
 
             if (directory == "<internal>" && eval_file == EvalFileDefaultName)
             {
-                // C++ way to prepare a buffer for a memory stream
-                class MemoryBuffer : public basic_streambuf<char> {
-                    public: MemoryBuffer(char* p, size_t n) { setg(p, p, p + n); setp(p, p + n); }
-                };
-
                 MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(gEmbeddedNNUEData)),
                                     size_t(gEmbeddedNNUESize));
 
@@ -122,6 +130,36 @@ namespace Eval {
                     eval_file_loaded = eval_file;
             }
         }
+
+    // The small network is optional, and looked for in the same places
+    if (eval_file_small_loaded != eval_file_small)
+    {
+        unload_small();
+        eval_file_small_loaded = "None";
+
+        for (string directory : dirs)
+            if (eval_file_small != "<empty>" && eval_file_small_loaded != eval_file_small)
+            {
+                if (directory != "<internal>")
+                {
+                    ifstream stream(directory + eval_file_small, ios::binary);
+                    if (load_eval_small(stream))
+                        eval_file_small_loaded = eval_file_small;
+                }
+
+                if (directory == "<internal>" && eval_file_small == EvalFileSmallDefaultName)
+                {
+                    MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(gEmbeddedNNUESmallData)),
+                                        size_t(gEmbeddedNNUESmallSize));
+
+                    istream stream(&buffer);
+                    if (load_eval_small(stream))
+                        eval_file_small_loaded = eval_file_small;
+                }
+            }
+    }
+
+    set_int8(Options["NNUE Int8 Weights"]);
   }
 
   /// NNUE::export_net() exports the currently loaded network to a file
@@ -172,6 +210,13 @@ namespace Eval {
 
         exit(EXIT_FAILURE);
     }
+
+    // Without its small network the engine still runs, as if none was set
+    string eval_file_small = string(Options["EvalFileSmall"]);
+
+    if (useNNUE && eval_file_small != "<empty>" && eval_file_small_loaded != eval_file_small)
+        sync_cout << "info string ERROR: The small network file " << eval_file_small
+                  << " was not loaded successfully, it will not be used." << sync_endl;
   }
 }
 
@@ -225,6 +270,33 @@ namespace {
   constexpr Value NNUEThreshold1 =   Value(682);
   constexpr Value NNUEThreshold2 =   Value(176);
 
+  // A cached decision skips the classical evaluation when it has been discarded
+  // at least HybridSkipRatio times as often as kept (plus HybridSkipMin), but
+  // the classical evaluation is still run once every HybridRecheck skips.
+  constexpr int HybridSkipRatio = 4;
+  constexpr int HybridSkipMin   = 4;
+  constexpr int HybridRecheck   = 8;
+
+  // add() adds to a counter of the hybrid stats, which only its thread writes
+  void add(std::atomic<uint64_t>& counter, uint64_t n) {
+
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // sampled() calls the given evaluator, timing one call out of HybridSampleRate
+  template<typename F>
+  Value sampled(F&& f, std::atomic<uint64_t>& calls, std::atomic<uint64_t>& ns) {
+
+    add(calls, 1);
+    if (calls.load(std::memory_order_relaxed) % Eval::HybridSampleRate)
+        return f();
+
+    auto start = std::chrono::steady_clock::now();
+    Value v = f();
+    add(ns, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    return v;
+  }
+
   // KingAttackWeights[PieceType] contains king attack weights by piece type
   constexpr int KingAttackWeights[PIECE_TYPE_NB] = { 0, 0, 81, 52, 44, 10 };
 
@@ -1110,6 +1182,7 @@ void Eval::init(bool verify)
 {
     NNUE::init(); //This will also initialize 'useNNUE' variable
     useClassical = Options["Use Classical Evaluation"];
+    useHybridCache = Options["Hybrid Eval Cache"];
 
     if (verify)
     {
@@ -1133,6 +1206,9 @@ void Eval::init(bool verify)
         else
             assert(false); //Should never reach here!
 
+        if (useNNUE && NNUE::has_small())
+            ss << "\ninfo string Small NNUE network (using " << Eval::eval_file_small_loaded << ") for lopsided positions";
+
         sync_cout << ss.str() << sync_endl;
     }
 }
@@ -1150,12 +1226,12 @@ Value Eval::evaluate(const Position& pos) {
   else
   {
       // Scale and shift NNUE for compatibility with search and classical evaluation
-      auto  adjusted_NNUE = [&]()
+      auto  adjusted_NNUE = [&](bool small = false, bool* lazy = nullptr)
       {
 
          int scale = 903 + 28 * pos.count<PAWN>() + 28 * pos.non_pawn_material() / 1024;
 
-         Value nnue = NNUE::evaluate(pos, true) * scale / 1024;
+         Value nnue = (small ? NNUE::evaluate_small(pos, true) : NNUE::evaluate(pos, true, lazy)) * scale / 1024;
 
          if (pos.is_chess960())
              nnue += fix_FRC(pos);
@@ -1165,12 +1241,33 @@ Value Eval::evaluate(const Position& pos) {
 
       if (!Eval::useClassical)
       {
-          v = adjusted_NNUE();
+          bool lazy = false;
+          v = adjusted_NNUE(false, &lazy);
+
+          if (lazy && NNUE::has_small())
+              v = adjusted_NNUE(true);
       }
       else
       {
-          // If there is PSQ imbalance we use the classical eval. We also introduce
-          // a small probability of using the classical eval when PSQ imbalance is small.
+          HybridStats& stats = pos.this_thread()->hybridStats;
+          auto classical_eval = [&]() { return sampled([&]() { return Evaluation<NO_TRACE>(pos).value(); },
+                                                       stats.classicalCalls, stats.classicalNs); };
+          auto small_eval     = [&]() { return sampled([&]() { return adjusted_NNUE(true); },
+                                                       stats.smallCalls, stats.smallNs); };
+
+          // The main network only returns the PSQT part for a clearly won
+          // position, which the small network, if loaded, evaluates in full.
+          // 'small' is its evaluation when it has already been computed.
+          auto nnue_eval      = [&](Value small = VALUE_NONE) {
+              bool lazy = false;
+              Value nnue = sampled([&]() { return adjusted_NNUE(false, &lazy); }, stats.nnueCalls, stats.nnueNs);
+              return !lazy || !NNUE::has_small() ? nnue
+                   : small != VALUE_NONE         ? small
+                                                 : small_eval();
+          };
+
+          // If there is PSQ imbalance we use the classical eval, or the small
+          // network if one is loaded, which is cheaper than both other evals.
           Value psq = Value(abs(eg_value(pos.psq_score())));
           int   r50 = 16 + pos.rule50_count();
           bool  largePsq = psq * 16 > (NNUEThreshold1 + pos.non_pawn_material() / 64) * r50;
@@ -1180,9 +1277,34 @@ Value Eval::evaluate(const Position& pos) {
           // One critical case is the draw for bishop + A/H file pawn vs naked king.
           bool lowPieceEndgame =   pos.non_pawn_material() == BishopValueMg
                                 || (pos.non_pawn_material() < 2 * RookValueMg && pos.count<PAWN>() < 2);
-          
-          v = classical || lowPieceEndgame ? Evaluation<NO_TRACE>(pos).value()
-                                           : adjusted_NNUE();
+
+          // In a PSQ imbalanced position the classical eval may be computed only
+          // to be replaced by NNUE below. If this is what usually happened with
+          // the same material and pawns, go for NNUE directly.
+          HybridEntry* he = nullptr;
+          if (largePsq && !lowPieceEndgame && Eval::useHybridCache)
+          {
+              Key key = pos.material_key() ^ pos.pawn_key();
+              he = pos.this_thread()->hybridTable[key];
+
+              if (he->key != key)
+                  *he = { key, 0, 0, 0 };
+
+              else if (   he->discarded >= HybridSkipRatio * he->kept + HybridSkipMin
+                       && ++he->skips % HybridRecheck)
+              {
+                  add(stats.skipped, 1);
+                  v = nnue_eval();
+                  goto damp;
+              }
+          }
+
+          bool small = classical && !lowPieceEndgame && NNUE::has_small();
+
+          v = lowPieceEndgame ? classical_eval()
+            : small           ? small_eval()
+            : classical       ? classical_eval()
+                              : nnue_eval();
           
           // If the classical eval is small and imbalance large, use NNUE nevertheless.
           // For the case of opposite colored bishops, switch to NNUE eval with small
@@ -1192,10 +1314,19 @@ Value Eval::evaluate(const Position& pos) {
               && (   abs(v) * 16 < NNUEThreshold2 * r50
                   || (   pos.opposite_bishops()
                       && abs(v) * 16 < (NNUEThreshold1 + pos.non_pawn_material() / 64) * r50)))
-              v = adjusted_NNUE();
+          {
+              add(stats.both, 1);
+              v = nnue_eval(small ? v : VALUE_NONE);
+
+              if (he && ++he->discarded == 255)
+                  he->discarded /= 2, he->kept /= 2;
+          }
+          else if (he && ++he->kept == 255)
+              he->discarded /= 2, he->kept /= 2;
       }
   }
 
+damp:
   // Damp down the evaluation linearly when shuffling
   v = v * (100 - pos.rule50_count()) / 100;
 
@@ -1205,6 +1336,62 @@ Value Eval::evaluate(const Position& pos) {
   return v;
 }
 
+/// hybrid_stats() returns a summary of how the classical and NNUE evaluators
+/// have been used by all threads since the last 'ucinewgame', together with
+/// their estimated cost. Only evaluations with both evaluators enabled count.
+
+std::string Eval::hybrid_stats() {
+
+  struct {
+    uint64_t classicalCalls, nnueCalls, smallCalls;
+    uint64_t classicalNs, nnueNs, smallNs;
+    uint64_t both, skipped;
+  } total = {};
+
+  auto get = [](const std::atomic<uint64_t>& c) { return c.load(std::memory_order_relaxed); };
+
+  for (Thread* th : Threads)
+  {
+      const HybridStats& s = th->hybridStats;
+      total.classicalCalls += get(s.classicalCalls);
+      total.nnueCalls      += get(s.nnueCalls);
+      total.smallCalls     += get(s.smallCalls);
+      total.classicalNs    += get(s.classicalNs);
+      total.nnueNs         += get(s.nnueNs);
+      total.smallNs        += get(s.smallNs);
+      total.both           += get(s.both);
+      total.skipped        += get(s.skipped);
+  }
+
+  uint64_t evals = total.classicalCalls + total.nnueCalls + total.smallCalls - total.both;
+
+  // Average time per call from the sampled calls
+  double classicalNs = total.classicalCalls >= HybridSampleRate ?
+                       double(total.classicalNs) / (total.classicalCalls / HybridSampleRate) : 0;
+  double nnueNs      = total.nnueCalls >= HybridSampleRate ?
+                       double(total.nnueNs) / (total.nnueCalls / HybridSampleRate) : 0;
+  double smallNs     = total.smallCalls >= HybridSampleRate ?
+                       double(total.smallNs) / (total.smallCalls / HybridSampleRate) : 0;
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2)
+     << "Hybrid evaluations : " << evals
+     << "\nClassical calls    : " << total.classicalCalls
+     << " (" << std::setprecision(0) << classicalNs << " ns/call)"
+     << "\nNNUE calls         : " << total.nnueCalls
+     << " (" << nnueNs << " ns/call)"
+     << "\nSmall NNUE calls   : " << total.smallCalls
+     << " (" << smallNs << " ns/call)"
+     << "\nBoth evaluators    : " << total.both
+     << " (" << std::setprecision(2) << 100.0 * total.both / std::max(evals, uint64_t(1)) << "%, "
+     << total.both * (total.smallCalls ? smallNs : classicalNs) / 1e6 << " ms spent in discarded "
+     << (total.smallCalls ? "small NNUE" : "classical") << " evals)"
+     << "\nClassical skipped  : " << total.skipped
+     << " (" << total.skipped * classicalNs / 1e6 << " ms saved by the hybrid cache)";
+
+  return ss.str();
+}
+
 /// trace() is like evaluate(), but instead of returning a value, it returns
 /// a string (suitable for outputting to stdout) that contains the detailed
 /// descriptions and values of each evaluation term. Useful for debugging.
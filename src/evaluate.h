@@ -19,9 +19,11 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include <atomic>
 #include <string>
 #include <optional>
 
+#include "misc.h"
 #include "types.h"
 
 namespace Stockfish {
@@ -30,27 +32,72 @@ class Position;
 
 namespace Eval {
 
+  /// HybridEntry remembers, for a material and pawn configuration, how often the
+  /// classical evaluation of a PSQ imbalanced position has been kept or discarded
+  /// in favour of NNUE, so that a classical evaluation which would be thrown away
+  /// anyhow can be skipped.
+  struct HybridEntry {
+    Key key;
+    uint8_t kept, discarded, skips;
+  };
+
+  typedef HashTable<HybridEntry, 8192> HybridTable;
+
+  /// HybridStats counts, per thread, how the evaluators are used when both
+  /// classical and NNUE evaluation are enabled. One call out of HybridSampleRate
+  /// of each evaluator is timed to estimate their cost. Only the thread itself
+  /// writes them, with relaxed loads and stores, and the telemetry reads them
+  /// meanwhile. They are cleared by 'ucinewgame'.
+  struct HybridStats {
+    std::atomic<uint64_t> classicalCalls { 0 }, nnueCalls { 0 }, smallCalls { 0 };
+    std::atomic<uint64_t> classicalNs { 0 }, nnueNs { 0 }, smallNs { 0 };
+    std::atomic<uint64_t> both { 0 }, skipped { 0 };
+
+    void clear() {
+      for (auto* c : { &classicalCalls, &nnueCalls, &smallCalls, &classicalNs, &nnueNs, &smallNs, &both, &skipped })
+          c->store(0, std::memory_order_relaxed);
+    }
+  };
+
+  constexpr uint64_t HybridSampleRate = 1024;
+
   void init(bool verify);
   std::string trace(const Position& pos);
+  std::string hybrid_stats();
   Value evaluate(const Position& pos);
 
   extern bool useNNUE;
   extern bool useClassical;
   extern std::string eval_file_loaded;
+  extern std::string eval_file_small_loaded;
 
   // The default net name MUST follow the format nn-[SHA256 first 12 digits].nnue
   // for the build process (profile-build and fishtest) to work. Do not change the
   // name of the macro, as it is used in the Makefile.
   #define EvalFileDefaultName   "nn-7756374aaed3.nnue"
 
+  // The small net for lopsided positions is embedded, and used by default, only
+  // if the build names one with 'make build EVALFILE_SMALL=<file>'.
+  #if defined(EVALFILE_SMALL)
+  #define EvalFileSmallDefaultName EVALFILE_SMALL
+  #else
+  #define EvalFileSmallDefaultName "<empty>"
+  #endif
+
   namespace NNUE {
 
-    Value evaluate(const Position& pos, bool adjusted = false);
+    Value evaluate(const Position& pos, bool adjusted = false, bool* lazy = nullptr);
+    Value evaluate_small(const Position& pos, bool adjusted = false);
     bool load_eval(std::string name, std::istream& stream);
+    bool load_eval_small(std::istream& stream);
+    void unload_small();
+    bool has_small();
     bool save_eval(std::ostream& stream);
     void init();
     void export_net(const std::optional<std::string>& filename);
     void verify();
+    size_t memory();
+    void set_int8(bool enable);
 
   } // namespace NNUE
 
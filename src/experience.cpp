@@ -20,17 +20,43 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <sstream>
 #include <fstream>
 #include <vector>
 #include <stdio.h> //For: remove()
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#  define NOMINMAX // Disable macros min() and max()
+#endif
+#include <windows.h>
+#endif
+
+#include "bitboard.h"
 #include "misc.h"
 #include "uci.h"
 #include "position.h"
 #include "thread.h"
 #include "experience.h"
+#include "expmap.h"
+#include "memory.h"
 
 using namespace std;
 using namespace Stockfish;
@@ -253,12 +279,277 @@ namespace Experience
         };
     }
 
+    ////////////////////////////////////////////////////////////////
+    // V3
+    ////////////////////////////////////////////////////////////////
+    //V3 files store the same entries as V2, compressed in independent blocks
+    //appended after the signature. Each block holds up to 'BlockEntries' entries,
+    //sorted by key by the writers, and starts with a 'BlockHeader'. Every entry is
+    //stored as:
+    //  - Key difference with the previous entry of the block (varint, wrapping)
+    //  - Move (16 bits)
+    //  - Value and depth (zigzag varints)
+    //  - Count (varint)
+    //Files are written as one sorted run (on full save) or as small appended runs
+    //(incremental saves), so key deltas are short and a typical entry takes 9 to 12
+    //bytes instead of 24.
+    namespace V3
+    {
+        const char*  ExperienceSignature = "SugaR Experience version 3";
+        const size_t ExperienceSignatureLength = strlen(ExperienceSignature) * sizeof(char);
+        const int    ExperienceVersion = 3;
+
+        constexpr size_t BlockEntries = 4096;
+        constexpr size_t MaxEntrySize = 10 + 2 + 3 + 5 + 3;
+
+        struct BlockHeader
+        {
+            uint32_t count;    //Number of entries in the block
+            uint32_t size;     //Payload size in bytes
+            uint64_t checksum; //Checksum of the payload
+        };
+
+        static_assert(sizeof(BlockHeader) == 16);
+
+        inline uint64_t checksum(const uint8_t* data, size_t size)
+        {
+            uint64_t h = 0x9E3779B97F4A7C15ULL ^ size;
+            uint64_t w;
+
+            for (; size >= 8; data += 8, size -= 8)
+            {
+                memcpy(&w, data, 8);
+                h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+                h ^= h >> 32;
+            }
+
+            for (; size; ++data, --size)
+                h = (h ^ *data) * 0xFF51AFD7ED558CCDULL;
+
+            return h ^ (h >> 29);
+        }
+
+        inline void put_varint(vector<uint8_t>& buf, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                buf.push_back(uint8_t(v) | 0x80);
+                v >>= 7;
+            }
+
+            buf.push_back(uint8_t(v));
+        }
+
+        inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+        {
+            v = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7)
+            {
+                uint8_t b = *p++;
+                v |= uint64_t(b & 0x7F) << shift;
+
+                if (!(b & 0x80))
+                    return true;
+            }
+
+            return false;
+        }
+
+        inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+        inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+        //Returns true if the given file starts with the V3 signature
+        bool has_signature(const string& filename)
+        {
+            vector<char> sig(ExperienceSignatureLength);
+            ifstream in(filename, ios::in | ios::binary);
+
+            return in.read(sig.data(), sig.size()) && memcmp(sig.data(), ExperienceSignature, sig.size()) == 0;
+        }
+
+        //Sort entries by key (then move) so that key deltas are as short as possible
+        template<typename T> void sort_entries(vector<T*>& entries)
+        {
+            sort(entries.begin(), entries.end(), [](const T* e1, const T* e2) {
+                return e1->key != e2->key ? e1->key < e2->key : e1->move < e2->move;
+            });
+        }
+
+        //Decodes the entry at 'cur', 'prevKey' is the key of the previous entry of the block (0 for the first one)
+        inline bool decode_entry(const uint8_t*& cur, const uint8_t* end, Key& prevKey, ExpEntry& exp)
+        {
+            uint64_t delta, value, depth, count;
+            if (   !get_varint(cur, end, delta)
+                || end - cur < 2)
+                return false;
+
+            exp.key  = prevKey + delta;
+            exp.move = Move(cur[0] | (cur[1] << 8));
+            cur += 2;
+
+            if (   !get_varint(cur, end, value)
+                || !get_varint(cur, end, depth)
+                || !get_varint(cur, end, count))
+                return false;
+
+            exp.value = Value(unzigzag(value));
+            exp.depth = Depth(unzigzag(depth));
+            exp.count = uint16_t(count);
+
+            prevKey = exp.key;
+            return true;
+        }
+
+        class BlockWriter
+        {
+        private:
+            ostream&        out;
+            vector<uint8_t> payload;
+            uint32_t        count = 0;
+            Key             prevKey = 0;
+
+        public:
+            explicit BlockWriter(ostream& o) : out(o)
+            {
+                payload.reserve(BlockEntries * MaxEntrySize);
+            }
+
+            bool write(const ExpEntry& exp)
+            {
+                assert(uint32_t(exp.move) <= 0xFFFF);
+
+                put_varint(payload, exp.key - prevKey);
+                payload.push_back(uint8_t(exp.move));
+                payload.push_back(uint8_t(exp.move >> 8));
+                put_varint(payload, zigzag(exp.value));
+                put_varint(payload, zigzag(exp.depth));
+                put_varint(payload, exp.count);
+
+                prevKey = exp.key;
+
+                return ++count < BlockEntries || flush();
+            }
+
+            bool flush()
+            {
+                if (!count)
+                    return true;
+
+                BlockHeader header = { count, uint32_t(payload.size()), checksum(payload.data(), payload.size()) };
+
+                out.write((const char*)&header, sizeof(header));
+                out.write((const char*)payload.data(), payload.size());
+
+                payload.clear();
+                count = 0;
+                prevKey = 0;
+
+                return bool(out);
+            }
+        };
+
+        class ExperienceReader : public Experience::ExperienceReader
+        {
+        private:
+            vector<uint8_t> payload;
+            const uint8_t*  cur = nullptr;
+            const uint8_t*  end = nullptr;
+            uint32_t        remaining = 0;
+            Key             prevKey = 0;
+
+        public:
+            explicit ExperienceReader() {}
+
+        public:
+            virtual int get_version()
+            {
+                return ExperienceVersion;
+            }
+
+            //Checks the signature, then walks the block headers to count the entries
+            //and make sure the file ends on a block boundary
+            virtual bool check_signature(ifstream& input, size_t inputLength)
+            {
+                match = false;
+                entriesCount = 0;
+                remaining = 0;
+
+                if (inputLength < ExperienceSignatureLength)
+                    return false;
+
+                vector<char> sig(ExperienceSignatureLength);
+                input.seekg(0, ios::beg);
+                if (!input.read(sig.data(), ExperienceSignatureLength) || memcmp(sig.data(), ExperienceSignature, ExperienceSignatureLength) != 0)
+                {
+                    input.clear();
+                    return false;
+                }
+
+                size_t pos = ExperienceSignatureLength;
+                BlockHeader header;
+                while (pos < inputLength && inputLength - pos >= sizeof(BlockHeader))
+                {
+                    input.seekg(pos, ios::beg);
+                    if (!input.read((char*)&header, sizeof(header)))
+                        break;
+
+                    pos += sizeof(BlockHeader) + header.size;
+                    entriesCount += header.count;
+                }
+
+                input.clear();
+                input.seekg(ExperienceSignatureLength, ios::beg);
+
+                match = pos == inputLength;
+                if (!match)
+                    entriesCount = 0;
+
+                return match;
+            }
+
+            virtual bool read(ifstream& input, Current::ExpEntry& exp)
+            {
+                assert(match && input.is_open());
+
+                //Load and verify the next (non empty) block
+                while (!remaining)
+                {
+                    BlockHeader header;
+                    if (!input.read((char*)&header, sizeof(header)))
+                        return false;
+
+                    payload.resize(header.size);
+                    if (!input.read((char*)payload.data(), header.size))
+                        return false;
+
+                    if (checksum(payload.data(), payload.size()) != header.checksum)
+                    {
+                        sync_cout << "info string Experience block checksum mismatch" << sync_endl;
+                        return false;
+                    }
+
+                    cur = payload.data();
+                    end = cur + payload.size();
+                    remaining = header.count;
+                    prevKey = 0;
+                }
+
+                if (!decode_entry(cur, end, prevKey, exp))
+                    return false;
+
+                --remaining;
+
+                return true;
+            }
+        };
+    }
+
     ////////////////////////////////////////////////////////////////
     // Typedefs
     ////////////////////////////////////////////////////////////////
-    typedef SugaRKeyMap<ExpEntryEx*> ExpMap;
-    typedef SugaRKeyMap<ExpEntryEx*>::iterator ExpIterator;
-    typedef SugaRKeyMap<ExpEntryEx*>::const_iterator ExpConstIterator;
+    typedef ExpKeyMap<ExpEntryEx*> ExpMap;
+    typedef ExpKeyMap<ExpEntryEx*>::iterator ExpIterator;
+    typedef ExpKeyMap<ExpEntryEx*>::const_iterator ExpConstIterator;
 
     ////////////////////////////////////////////////////////////////
     // ExpEntryEx::quality
@@ -319,13 +610,13 @@ namespace Experience
                     break;
 
                 //Find best next experience move (shallow search)
-                const ExpEntryEx* temp2 = temp1 ? temp1->next : nullptr;
+                const ExpEntryEx* temp2 = temp1 ? temp1->next() : nullptr;
                 while (temp2)
                 {
                     if (temp2->compare(temp1) > 0)
                         temp1 = temp2;
 
-                    temp2 = temp2->next;
+                    temp2 = temp2->next();
                 }
 
                 if (lastExp[me])
@@ -376,15 +667,607 @@ namespace Experience
 #else
         constexpr size_t WriteBufferSize = 1024 * 1024 * 16;
 #endif
-        
+
+        //Memory needed by 'entries' loaded entries in 'positions' positions: the entries plus the map
+        pair<size_t, size_t> expected_memory(size_t entries, size_t positions)
+        {
+            return { entries * sizeof(ExpEntryEx), ExpMap::memory_for(positions) };
+        }
+
+        //Rules deciding which entries are kept when loading and fully saving experience
+        struct RetentionPolicy
+        {
+            Depth  minDepth;
+            int    minCount;
+            size_t maxMoves;  //Per position, 0 = unlimited
+            size_t maxSize;   //Memory budget in MB, 0 = unlimited
+
+            //The memory budget, if any, caps the size of the experience loaded by the engine. It is about the
+            //memory of this host, so it must not shrink the files that are fully rewritten.
+            static RetentionPolicy from_options(bool memoryBudget)
+            {
+                size_t maxSize = (size_t)(int)Options["Experience Max Size"];
+                size_t budget = memoryBudget ? Stockfish::Memory::experience_size() : 0;
+                if (budget)
+                    maxSize = maxSize ? min(maxSize, budget) : budget;
+
+                return { (Depth)(int)Options["Experience Min Depth"],
+                         (int)Options["Experience Min Count"],
+                         (size_t)(int)Options["Experience Max Moves"],
+                         maxSize };
+            }
+
+            bool enabled() const
+            {
+                return minDepth > EXP_MIN_DEPTH || minCount > 1 || maxMoves || maxSize;
+            }
+        };
+
+#if !defined(_WIN32) && defined(__ANDROID__)
+        //Bionic has no POSIX shared memory
+        #define EXP_NO_SHARED_MEMORY
+#endif
+
+        //Named memory object shared by all the processes of the host
+        class SharedMemory
+        {
+        private:
+            uint8_t* _data = nullptr;
+            size_t   _size = 0;
+#ifdef _WIN32
+            HANDLE   _mapping = nullptr;
+#endif
+
+        public:
+            SharedMemory() = default;
+            SharedMemory(const SharedMemory&) = delete;
+            SharedMemory& operator =(const SharedMemory&) = delete;
+
+            ~SharedMemory()
+            {
+                close();
+            }
+
+            //Creates a zero filled object of 'size' bytes. Fails, setting 'exists', if the name is already taken.
+            bool create(const string& name, size_t size, bool& exists)
+            {
+                exists = false;
+#if defined(_WIN32)
+                _mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), name.c_str());
+                if (!_mapping)
+                    return false;
+
+                if (GetLastError() == ERROR_ALREADY_EXISTS)
+                {
+                    exists = true;
+                    close();
+                    return false;
+                }
+
+                _data = (uint8_t*)MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#elif !defined(EXP_NO_SHARED_MEMORY)
+                int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+                if (fd == -1)
+                {
+                    exists = errno == EEXIST;
+                    return false;
+                }
+
+                if (ftruncate(fd, size) == 0)
+                {
+                    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    _data = p != MAP_FAILED ? (uint8_t*)p : nullptr;
+                }
+
+                ::close(fd);
+
+                if (!_data)
+                    unlink(name);
+#else
+                (void)name;
+                (void)size;
+#endif
+                _size = _data ? size : 0;
+                return _data != nullptr;
+            }
+
+            //Maps the first 'size' bytes of an existing object. Fails if it is not that large (yet).
+            bool open(const string& name, size_t size, bool writable)
+            {
+#if defined(_WIN32)
+                _mapping = OpenFileMappingA(writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, name.c_str());
+                if (!_mapping)
+                    return false;
+
+                _data = (uint8_t*)MapViewOfFile(_mapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+#elif !defined(EXP_NO_SHARED_MEMORY)
+                int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+                if (fd == -1)
+                    return false;
+
+                struct stat statbuf;
+                if (fstat(fd, &statbuf) == 0 && size_t(statbuf.st_size) >= size)
+                {
+                    void* p = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+                    _data = p != MAP_FAILED ? (uint8_t*)p : nullptr;
+                }
+
+                ::close(fd);
+#else
+                (void)name;
+                (void)size;
+                (void)writable;
+#endif
+                _size = _data ? size : 0;
+                return _data != nullptr;
+            }
+
+            void close()
+            {
+#if defined(_WIN32)
+                if (_data)
+                    UnmapViewOfFile(_data);
+
+                if (_mapping)
+                    CloseHandle(_mapping);
+
+                _mapping = nullptr;
+#elif !defined(EXP_NO_SHARED_MEMORY)
+                if (_data)
+                    munmap(_data, _size);
+#endif
+                _data = nullptr;
+                _size = 0;
+            }
+
+            //Removes the name, the object itself goes away once no process maps it anymore.
+            //On Windows this happens on its own when the last handle is closed.
+            static void unlink(const string& name)
+            {
+#if !defined(_WIN32) && !defined(EXP_NO_SHARED_MEMORY)
+                shm_unlink(name.c_str());
+#else
+                (void)name;
+#endif
+            }
+
+            uint8_t* data() const { return _data; }
+            size_t size() const { return _size; }
+        };
+
+        //Host-wide read only copy of an experience file. The first process to load the file claims a small control
+        //object, loads the file privately and publishes its positions in a data object: an open addressing table of
+        //keys followed by the moves, chained by offset. The other processes wait for the data and map it read only.
+        //The control object lists the process id of each user, so that the users that died without releasing the
+        //data are dropped, and the names of a segment nobody uses any more are removed.
+        class SharedExperience
+        {
+        private:
+            static constexpr size_t MaxUsers = 64;
+            static constexpr uint64_t Magic = 0x5375676152455850ULL + sizeof(ExpEntryEx) + (MaxUsers << 16);
+
+            enum State : uint32_t { Building, Ready, Failed, Closing };
+
+            struct Control
+            {
+                uint64_t         magic;
+                atomic<uint32_t> state;
+                atomic<uint64_t> builder;
+                uint64_t         bucketCount;
+                uint64_t         positionCount;
+                uint64_t         entryCount;
+                atomic<uint64_t> users[MaxUsers]; //Process ids, 0 for a free slot
+            };
+
+            struct Bucket
+            {
+                Key      key;
+                uint64_t entry;
+            };
+
+            string            _name;
+            SharedMemory      _control;
+            SharedMemory      _data;
+            size_t            _slot = MaxUsers;
+
+            const Bucket*     _buckets = nullptr;
+            const ExpEntryEx* _entries = nullptr;
+            size_t            _mask = 0;
+
+            Control* control() const { return (Control*)_control.data(); }
+
+            static bool process_alive(uint64_t pid)
+            {
+#if defined(_WIN32)
+                HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, DWORD(pid));
+                if (!h)
+                    return false;
+
+                bool alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+                CloseHandle(h);
+                return alive;
+#else
+                return kill(pid_t(pid), 0) == 0 || errno != ESRCH;
+#endif
+            }
+
+            bool map_data(size_t buckets, size_t entries, bool create)
+            {
+                size_t size = buckets * sizeof(Bucket) + entries * sizeof(ExpEntryEx);
+
+                bool exists;
+                if (create ? !_data.create(_name + "-data", size, exists) : !_data.open(_name + "-data", size, false))
+                    return false;
+
+                _buckets = (const Bucket*)_data.data();
+                _entries = (const ExpEntryEx*)(_buckets + buckets);
+                _mask = buckets - 1;
+
+                return true;
+            }
+
+            static void remove_names(const string& name)
+            {
+                SharedMemory::unlink(name + "-data");
+                SharedMemory::unlink(name);
+            }
+
+            //Takes a free slot, or the slot of a dead process, for this process
+            bool add_user(Control* ctl)
+            {
+                uint64_t pid = process_id();
+
+                for (size_t i = 0; i < MaxUsers; ++i)
+                {
+                    uint64_t user = ctl->users[i].load(memory_order_acquire);
+                    if (   (!user || (user != pid && !process_alive(user)))
+                        && ctl->users[i].compare_exchange_strong(user, pid, memory_order_acq_rel))
+                    {
+                        _slot = i;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            //Frees the slots of the dead processes and tells whether any user is left
+            static bool has_users(Control* ctl)
+            {
+                bool any = false;
+
+                for (auto& u : ctl->users)
+                {
+                    uint64_t user = u.load(memory_order_acquire);
+                    if (user && !process_alive(user))
+                        u.compare_exchange_strong(user, 0, memory_order_acq_rel);
+                    else if (user)
+                        any = true;
+                }
+
+                return any;
+            }
+
+            //Removes the names of a published or failed segment without users. The process that moves it to
+            //Closing removes them, a process that finds it already Closing does it again in case that one died.
+            static void close_if_unused(const string& name, Control* ctl)
+            {
+                uint32_t state = ctl->state.load(memory_order_acquire);
+
+                if (    state == Closing
+                    || (state != Building && !has_users(ctl) && ctl->state.compare_exchange_strong(state, Closing, memory_order_acq_rel)))
+                    remove_names(name);
+            }
+
+            //Removes the segments left by dead processes for other experience files or older versions of this one,
+            //which no process would open again. They are found in /dev/shm, so only on Linux.
+            void collect_orphans() const
+            {
+#if defined(__linux__) && !defined(EXP_NO_SHARED_MEMORY)
+                vector<string> names;
+
+                if (DIR* dir = opendir("/dev/shm"))
+                {
+                    while (dirent* e = readdir(dir))
+                    {
+                        string name = string("/") + e->d_name;
+                        if (name.rfind("/SugaR-exp-", 0) == 0 && name.size() == _name.size() && name != _name)
+                            names.push_back(name);
+                    }
+
+                    closedir(dir);
+                }
+
+                for (const string& name : names)
+                {
+                    SharedMemory shm;
+                    if (!shm.open(name, sizeof(Control), true))
+                        continue;
+
+                    Control* ctl = (Control*)shm.data();
+                    if (ctl->magic != Magic)
+                        continue; //Another build, which may lay out the control object differently
+
+                    uint64_t builder = ctl->builder.load(memory_order_acquire);
+                    if (ctl->state.load(memory_order_acquire) != Building)
+                        close_if_unused(name, ctl);
+                    else if (builder && !process_alive(builder))
+                        remove_names(name);
+                }
+#endif
+            }
+
+            //Drops this process from the users, the last one removes the names
+            void release()
+            {
+                Control* ctl = control();
+                if (ctl && _slot < MaxUsers)
+                {
+                    ctl->users[_slot].store(0, memory_order_release);
+                    close_if_unused(_name, ctl);
+                }
+
+                _slot = MaxUsers;
+                _data.close();
+                _control.close();
+                _buckets = nullptr;
+                _entries = nullptr;
+            }
+
+        public:
+            enum AttachResult { Attached, Claimed, Unavailable };
+
+            static uint64_t process_id()
+            {
+#ifdef _WIN32
+                return GetCurrentProcessId();
+#else
+                return getpid();
+#endif
+            }
+
+            SharedExperience(const SharedExperience&) = delete;
+            SharedExperience& operator =(const SharedExperience&) = delete;
+
+            //The name identifies the file and its version, so a modified file gets a new segment
+            explicit SharedExperience(const string& filename)
+            {
+                uint64_t size = 0, mtime = 0;
+#ifdef _WIN32
+                WIN32_FILE_ATTRIBUTE_DATA attr;
+                if (GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attr))
+                {
+                    size = (uint64_t(attr.nFileSizeHigh) << 32) | attr.nFileSizeLow;
+                    mtime = (uint64_t(attr.ftLastWriteTime.dwHighDateTime) << 32) | attr.ftLastWriteTime.dwLowDateTime;
+                }
+#else
+                struct stat statbuf;
+                if (stat(filename.c_str(), &statbuf) == 0)
+                {
+                    size = statbuf.st_size;
+                    mtime = statbuf.st_mtime;
+                }
+#endif
+                size_t h = std::hash<string>()(filename + ":" + to_string(size) + ":" + to_string(mtime) + ":" + to_string(Magic));
+
+                stringstream ss;
+#ifdef _WIN32
+                ss << "Local\\SugaR-exp-";
+#else
+                ss << "/SugaR-exp-";
+#endif
+                ss << hex << setw(16) << setfill('0') << h;
+                _name = ss.str();
+            }
+
+            ~SharedExperience()
+            {
+                release();
+            }
+
+            string name() const
+            {
+                return _name;
+            }
+
+            //Maps the experience if another process has published it, waiting while it is being built. Otherwise
+            //this process becomes the builder and must publish() or abandon() it.
+            AttachResult attach()
+            {
+                collect_orphans();
+
+                while (true)
+                {
+                    bool exists;
+                    if (_control.create(_name, sizeof(Control), exists))
+                    {
+                        Control* ctl = control();
+                        ctl->magic = Magic;
+                        add_user(ctl);
+                        ctl->builder.store(process_id(), memory_order_release);
+                        return Claimed;
+                    }
+
+                    if (!exists)
+                        return Unavailable;
+
+                    //The builder may not have sized the object yet
+                    if (!_control.open(_name, sizeof(Control), true))
+                    {
+                        this_thread::sleep_for(chrono::milliseconds(10));
+                        continue;
+                    }
+
+                    Control* ctl = control();
+                    if (ctl->magic != 0 && ctl->magic != Magic)
+                    {
+                        _control.close();
+                        return Unavailable;
+                    }
+
+                    uint32_t state;
+                    while ((state = ctl->state.load(memory_order_acquire)) == Building)
+                    {
+                        uint64_t builder = ctl->builder.load(memory_order_acquire);
+                        if (builder && !process_alive(builder))
+                            break;
+
+                        this_thread::sleep_for(chrono::milliseconds(10));
+                    }
+
+                    //The builder died: remove the stale names so that the next process can claim them again
+                    if (state == Building)
+                    {
+                        remove_names(_name);
+                        _control.close();
+                        return Unavailable;
+                    }
+
+                    if (state != Closing && !add_user(ctl))
+                    {
+                        _control.close();
+                        return Unavailable;
+                    }
+
+                    //The last user is removing the names: retry once it is done
+                    if (state == Closing || ctl->state.load(memory_order_acquire) == Closing)
+                    {
+                        if (_slot < MaxUsers)
+                            ctl->users[_slot].store(0, memory_order_release);
+
+                        _slot = MaxUsers;
+                        close_if_unused(_name, ctl);
+                        _control.close();
+                        this_thread::sleep_for(chrono::milliseconds(10));
+                        continue;
+                    }
+
+                    if (state == Ready && map_data(ctl->bucketCount, ctl->entryCount, false))
+                        return Attached;
+
+                    release();
+                    return Unavailable;
+                }
+            }
+
+            //Copies the positions of 'exp' to the data object and lets the waiting processes in
+            bool publish(const ExpMap& exp)
+            {
+                Control* ctl = control();
+                assert(ctl && ctl->state.load(memory_order_relaxed) == Building);
+
+                size_t entries = 0;
+                for (auto& x : exp)
+                    for (const ExpEntryEx* expEx = x.second; expEx; expEx = expEx->next())
+                        entries++;
+
+                size_t buckets = 32;
+                while (buckets <= 2 * exp.size())
+                    buckets *= 2;
+
+                if (!map_data(buckets, entries, true))
+                {
+                    abandon();
+                    return false;
+                }
+
+                Bucket* bucketData = (Bucket*)_data.data();
+                ExpEntryEx* entryData = (ExpEntryEx*)(bucketData + buckets);
+
+                size_t i = 0;
+                for (auto& x : exp)
+                {
+                    size_t b = x.first & _mask;
+                    while (bucketData[b].key)
+                        b = (b + 1) & _mask;
+
+                    bucketData[b].key = x.first;
+                    bucketData[b].entry = i;
+
+                    ExpEntryEx* last = nullptr;
+                    for (const ExpEntryEx* expEx = x.second; expEx; expEx = expEx->next())
+                    {
+                        ExpEntryEx* copy = entryData + i++;
+                        memcpy((void*)copy, (const void*)expEx, sizeof(ExpEntryEx));
+                        copy->set_next(nullptr);
+
+                        if (last)
+                            last->set_next(copy);
+
+                        last = copy;
+                    }
+                }
+
+                assert(i == entries);
+
+                ctl->bucketCount = buckets;
+                ctl->positionCount = exp.size();
+                ctl->entryCount = entries;
+                ctl->state.store(Ready, memory_order_release);
+
+                return true;
+            }
+
+            void abandon()
+            {
+                Control* ctl = control();
+                if (ctl)
+                    ctl->state.store(Failed, memory_order_release);
+
+                release();
+            }
+
+            bool attached() const
+            {
+                return _entries != nullptr;
+            }
+
+            size_t positions_count() const
+            {
+                return control()->positionCount;
+            }
+
+            size_t entries_count() const
+            {
+                return control()->entryCount;
+            }
+
+            size_t memory() const
+            {
+                return _control.size() + _data.size();
+            }
+
+            //The table is at most half full, so there is always an empty bucket to stop at
+            const ExpEntryEx* probe(Key k) const
+            {
+                for (size_t b = k & _mask; _buckets[b].key; b = (b + 1) & _mask)
+                    if (_buckets[b].key == k)
+                        return _entries + _buckets[b].entry;
+
+                return nullptr;
+            }
+
+            void prefetch(Key k) const
+            {
+                Stockfish::prefetch(_data.data() + (k & _mask) * sizeof(Bucket));
+            }
+        };
+
         class ExperienceData
         {
         private:
             string               _filename;
+            bool                 _shareable;
+            bool                 _budgeted; //Pruned to the memory budget when loaded
+            RetentionPolicy      _loadPolicy; //Taken by load(), the loader thread must not look at the threads
+            SharedExperience     *_shared;
 
             vector<ExpEntryEx*>  _expExData;
+            size_t               _expExDataSize = 0; //Bytes allocated in _expExData
             vector<ExpEntryEx*>  _newPvExpEx;
             vector<ExpEntryEx*>  _newMultiPvExpEx;
+            vector<ExpEntryEx*>  _savingPvExpEx;
+            vector<ExpEntryEx*>  _savingMultiPvExpEx;
             ExpMap               _mainExp;
 
             bool                _loading;
@@ -394,6 +1277,8 @@ namespace Experience
             condition_variable  _loadingCond;
             mutex               _loaderMutex;
 
+            thread              _saverThread;
+
         private:
             void clear()
             {
@@ -402,6 +1287,9 @@ namespace Experience
                 wait_for_load_finished();
                 assert(_loaderThread == nullptr);
 
+                //Complete pending save
+                wait_for_save_finished();
+
                 //Free
                 for (ExpEntryEx *&p : _expExData)
                     free(p);
@@ -409,24 +1297,161 @@ namespace Experience
                 //Clear
                 _mainExp.clear();
                 _expExData.clear();
+                _expExDataSize = 0;
+
+                //Detach from shared experience
+                delete _shared;
+                _shared = nullptr;
 
                 //Clear new exp
                 clear_new_exp();
             }
 
-            void clear_new_exp()
+            static void clear_exp(vector<ExpEntryEx*>& pvExpEx, vector<ExpEntryEx*>& multiPvExpEx)
             {
                 //Delete PV experience
-                for (const ExpEntryEx* expEx : _newPvExpEx)
+                for (const ExpEntryEx* expEx : pvExpEx)
                     delete expEx;
 
                 //Delete NonPV experience
-                for (const ExpEntryEx* expEx : _newMultiPvExpEx)
+                for (const ExpEntryEx* expEx : multiPvExpEx)
                     delete expEx;
 
                 //Clear vectors
-                _newPvExpEx.clear();
-                _newMultiPvExpEx.clear();
+                pvExpEx.clear();
+                multiPvExpEx.clear();
+            }
+
+            void clear_new_exp()
+            {
+                clear_exp(_newPvExpEx, _newMultiPvExpEx);
+                clear_exp(_savingPvExpEx, _savingMultiPvExpEx);
+            }
+
+            //Applies the retention policy to the experience in memory. For each position only the moves matching the
+            //depth and count rules are kept, up to 'maxMoves' of them in compare() order. If the result still does not
+            //fit in 'maxSize' MB, the minimum depth is raised until it does. The remaining entries are then moved to a
+            //single buffer so that the memory of the dropped ones is released.
+            void prune(const RetentionPolicy& policy)
+            {
+                if (!policy.enabled() || _mainExp.empty())
+                    return;
+
+                size_t entriesBefore = 0;
+                size_t positionsBefore = _mainExp.size();
+
+                //Step 1: Per position rules
+                vector<size_t> entriesAtDepth(MAX_PLY + 1), positionsAtDepth(MAX_PLY + 1);
+                vector<ExpEntryEx*> moves;
+
+                for (auto& x : _mainExp)
+                {
+                    moves.clear();
+                    for (ExpEntryEx* expEx = x.second; expEx; expEx = expEx->next())
+                    {
+                        entriesBefore++;
+                        if (expEx->depth >= policy.minDepth && expEx->count >= policy.minCount)
+                            moves.push_back(expEx);
+                    }
+
+                    //Merging may have changed the order of the moves since they were linked
+                    stable_sort(moves.begin(), moves.end(), [](const ExpEntryEx* a, const ExpEntryEx* b) { return a->compare(b) > 0; });
+
+                    if (policy.maxMoves && moves.size() > policy.maxMoves)
+                        moves.resize(policy.maxMoves);
+
+                    //Relink
+                    x.second = moves.empty() ? nullptr : moves.front();
+
+                    Depth maxDepth = DEPTH_NONE;
+                    for (size_t i = 0; i < moves.size(); ++i)
+                    {
+                        moves[i]->set_next(i + 1 < moves.size() ? moves[i + 1] : nullptr);
+                        entriesAtDepth[std::clamp(int(moves[i]->depth), 0, int(MAX_PLY))]++;
+                        maxDepth = max(maxDepth, moves[i]->depth);
+                    }
+
+                    if (!moves.empty())
+                        positionsAtDepth[std::clamp(int(maxDepth), 0, int(MAX_PLY))]++;
+                }
+
+                //Step 2: Raise the minimum depth until the memory budget is met. A position survives
+                //as long as its deepest move does.
+                size_t entries = accumulate(entriesAtDepth.begin(), entriesAtDepth.end(), size_t(0));
+                size_t positions = accumulate(positionsAtDepth.begin(), positionsAtDepth.end(), size_t(0));
+                Depth minDepth = DEPTH_NONE;
+
+                if (policy.maxSize)
+                {
+                    for (int d = 0; d <= MAX_PLY; ++d)
+                    {
+                        pair<size_t, size_t> memory = expected_memory(entries, positions);
+                        if ((memory.first + memory.second) >> 20 < policy.maxSize)
+                            break;
+
+                        minDepth = Depth(d + 1);
+                        entries -= entriesAtDepth[d];
+                        positions -= positionsAtDepth[d];
+                    }
+                }
+
+                //Nothing to release
+                if (entries == entriesBefore && positions == positionsBefore && _expExData.size() <= 1)
+                    return;
+
+                //Step 3: Move the remaining entries to a new buffer and rebuild the map
+                ExpEntryEx* expData = entries ? (ExpEntryEx*)malloc(entries * sizeof(ExpEntryEx)) : nullptr;
+                if (entries && !expData)
+                {
+                    sync_cout << "info string Failed to allocate " << entries * sizeof(ExpEntryEx) << " bytes for experience data compaction" << sync_endl;
+                    return;
+                }
+
+                vector<ExpMap::value_type> newPositions;
+                newPositions.reserve(positions);
+
+                size_t i = 0;
+                for (auto& x : _mainExp)
+                {
+                    ExpEntryEx* last = nullptr;
+                    for (ExpEntryEx* expEx = x.second; expEx; expEx = expEx->next())
+                    {
+                        if (expEx->depth < minDepth)
+                            continue;
+
+                        ExpEntryEx* copy = expData + i++;
+                        memcpy((void*)copy, (const void*)expEx, sizeof(ExpEntryEx));
+                        copy->set_next(nullptr);
+
+                        if (last)
+                            last->set_next(copy);
+                        else
+                            newPositions.emplace_back(x.first, copy);
+
+                        last = copy;
+                    }
+                }
+
+                assert(i == entries && newPositions.size() == positions);
+
+                ExpMap newExp;
+                newExp.build(newPositions);
+
+                for (ExpEntryEx*& p : _expExData)
+                    free(p);
+
+                _expExData.clear();
+                if (expData)
+                    _expExData.push_back(expData);
+
+                _expExDataSize = entries * sizeof(ExpEntryEx);
+
+                _mainExp.swap(newExp);
+
+                sync_cout << "info string Experience retention: kept " << entries << " of " << entriesBefore << " moves and "
+                          << positions << " of " << positionsBefore << " positions"
+                          << (minDepth > policy.minDepth ? ", minimum depth raised to " + to_string(minDepth) : "")
+                          << sync_endl;
             }
 
             bool link_entry(ExpEntryEx* expEx)
@@ -457,24 +1482,24 @@ namespace Experience
                         if (expEx2 == itr->second)
                         {
                             itr->second = expEx;
-                            expEx->next = expEx2;
+                            expEx->set_next(expEx2);
                         }
                         else
                         {
-                            expEx->next = expEx2->next;
-                            expEx2->next = expEx;
+                            expEx->set_next(expEx2->next());
+                            expEx2->set_next(expEx);
                         }
 
                         return true;
                     }
 
-                    if (!expEx2->next)
+                    if (!expEx2->next())
                     {
-                        expEx2->next = expEx;
+                        expEx2->set_next(expEx);
                         return true;
                     }
 
-                    expEx2 = expEx2->next;
+                    expEx2 = expEx2->next();
                 } while (true);
 
                 //Should never reach here!
@@ -508,6 +1533,7 @@ namespace Experience
                 public:
                     ExpReaders()
                     {
+                        readers.emplace_back("Experience (V3) reader", new V3::ExperienceReader());
                         readers.emplace_back("Experience (V2) reader", new V2::ExperienceReader());
                         readers.emplace_back("Experience (V1) reader", new V1::ExperienceReader());
 
@@ -573,7 +1599,7 @@ namespace Experience
 
                     //Prepare to read
                     ExpEntryEx* expEx = expData + i;
-                    expEx->next = nullptr;
+                    expEx->set_next(nullptr);
 
                     //Read
                     if (!reader->read(in, *expEx))
@@ -594,6 +1620,7 @@ namespace Experience
 
                 //Add buffer to vector so that it will be released later
                 _expExData.push_back(expData);
+                _expExDataSize += expCount * sizeof(ExpEntryEx);
 
                 //Stop if aborted
                 if (_abortLoading.load(memory_order_relaxed))
@@ -628,9 +1655,66 @@ namespace Experience
                         << sync_endl;
                 }
 
+                //Bound the experience kept in memory
+                prune(_loadPolicy);
+
                 return true;
             }
 
+            bool _load_shared(string fn)
+            {
+                SharedExperience* shared = new SharedExperience(Utility::map_path(fn));
+
+                switch (shared->attach())
+                {
+                case SharedExperience::Attached:
+                    _shared = shared;
+
+                    sync_cout
+                        << "info string " << fn << " -> Attached to shared experience " << shared->name()
+                        << ". Total moves: " << shared->entries_count()
+                        << ". Total positions: " << shared->positions_count()
+                        << sync_endl;
+
+                    return true;
+
+                case SharedExperience::Claimed:
+                    if (!_load(fn))
+                    {
+                        shared->abandon();
+                        delete shared;
+                        return false;
+                    }
+
+                    if (!shared->publish(_mainExp))
+                    {
+                        sync_cout << "info string Could not publish experience to shared memory, using a private copy" << sync_endl;
+                        delete shared;
+                        return true;
+                    }
+
+                    //Release the private copy
+                    for (ExpEntryEx*& p : _expExData)
+                        free(p);
+
+                    _expExData.clear();
+                    ExpMap().swap(_mainExp);
+
+                    _shared = shared;
+
+                    sync_cout << "info string " << fn << " -> Published to shared experience " << shared->name() << sync_endl;
+
+                    return true;
+
+                default:
+                    delete shared;
+
+                    sync_cout << "info string Shared experience is not available, loading a private copy" << sync_endl;
+
+                    return _load(fn);
+                }
+            }
+
             bool _save(string fn, bool saveAll)
             {
                 fstream out;
@@ -656,49 +1740,42 @@ namespace Experience
                         return false;
                     }
                 }
-
-                //Reposition writing pointer to end of file
-                out.seekp(ios::end);
-
-                vector<char> writeBuffer;
-                writeBuffer.reserve(WriteBufferSize);
-
-                auto write_entry = [&](const Current::ExpEntry* exp, bool force) -> bool
+                else
                 {
-                    if (exp)
+                    //New blocks can only be appended to a file of the current version
+                    if (!Current::has_signature(Utility::map_path(fn)))
                     {
-                        const char* data = reinterpret_cast<const char*>(exp);
-                        writeBuffer.insert(writeBuffer.end(), data, data + sizeof(Current::ExpEntry));
+                        sync_cout << "info string Cannot append to experience file [" << fn << "] of an older version, use 'defrag' to upgrade it first" << sync_endl;
+                        return false;
                     }
+                }
 
-                    bool success = true;
-                    if (force || writeBuffer.size() >= WriteBufferSize)
-                    {
-                        out.write(writeBuffer.data(), writeBuffer.size());
-                        if (!out)
-                            success = false;
-
-                        writeBuffer.clear();
-                    }
+                //Reposition writing pointer to end of file
+                out.seekp(ios::end);
 
-                    return success;
-                };
+                Current::BlockWriter writer(out);
 
                 size_t allMoves = 0;
                 size_t allPositions = 0;
                 if (saveAll)
                 {
-                    for (ExpEntryEx* expEx : _newPvExpEx)
-                        link_entry(expEx);
+                    for (const vector<ExpEntryEx*>* v : { &_newPvExpEx, &_newMultiPvExpEx, &_savingPvExpEx, &_savingMultiPvExpEx })
+                        for (ExpEntryEx* expEx : *v)
+                            link_entry(expEx);
 
-                    for (ExpEntryEx* expEx : _newMultiPvExpEx)
-                        link_entry(expEx);
+                    prune(RetentionPolicy::from_options(false));
 
-                    ExpEntryEx* expEx = nullptr;
+                    //Save positions in key order, all the moves of a position share its key
+                    vector<ExpEntryEx*> positions;
+                    positions.reserve(_mainExp.size());
                     for (auto& x : _mainExp)
+                        positions.push_back(x.second);
+
+                    Current::sort_entries(positions);
+
+                    for (ExpEntryEx* expEx : positions)
                     {
                         allPositions++;
-                        expEx = x.second;
 
                         //Scale counts
                         uint16_t maxCount = numeric_limits<uint8_t>::min();
@@ -706,7 +1783,7 @@ namespace Experience
                         while (expEx1)
                         {
                             maxCount = max(maxCount, expEx1->count);
-                            expEx1 = expEx1->next;
+                            expEx1 = expEx1->next();
                         }
 
                         //Scale down
@@ -715,7 +1792,7 @@ namespace Experience
                         while (expEx1)
                         {
                             expEx1->count = max(expEx1->count / scale, 1);
-                            expEx1 = expEx1->next;
+                            expEx1 = expEx1->next();
                         }
 
                         //Save
@@ -724,14 +1801,14 @@ namespace Experience
                             if (expEx->depth >= EXP_MIN_DEPTH)
                             {
                                 allMoves++;
-                                if (!write_entry(expEx, false))
+                                if (!writer.write(*expEx))
                                 {
                                     sync_cout << "info string Failed to save experience entry to experience file [" << fn << "]" << sync_endl;
                                     return false;
                                 }
                             }
 
-                            expEx = expEx->next;
+                            expEx = expEx->next();
                         }
                     }
 
@@ -739,72 +1816,78 @@ namespace Experience
                 }
                 else
                 {
-                    //Save new PV experience
-                    for (const ExpEntryEx* expEx : _newPvExpEx)
-                    {
-                        if (!expEx)
-                            continue;
-
-                        if (expEx->depth < EXP_MIN_DEPTH)
-                            continue;
+                    //Save new PV and MultiPV experience handed over by save()
+                    vector<const ExpEntryEx*> newExp;
+                    for (const vector<ExpEntryEx*>* v : { &_savingPvExpEx, &_savingMultiPvExpEx })
+                        for (const ExpEntryEx* expEx : *v)
+                            if (expEx && expEx->depth >= EXP_MIN_DEPTH)
+                                newExp.push_back(expEx);
 
-                        if (!write_entry(expEx, false))
-                        {
-                            sync_cout << "info string Failed to save new PV experience entry to experience file [" << fn << "]" << sync_endl;
-                            return false;
-                        }
-                    }
+                    Current::sort_entries(newExp);
 
-                    //Save new MultiPV experience
-                    for (const ExpEntryEx* expEx : _newMultiPvExpEx)
+                    for (const ExpEntryEx* expEx : newExp)
                     {
-                        if (!expEx)
-                            continue;
-
-                        if (expEx->depth < EXP_MIN_DEPTH)
-                            continue;
-
-                        if (!write_entry(expEx, false))
+                        if (!writer.write(*expEx))
                         {
-                            sync_cout << "info string Failed to save new MultiPV experience entry to experience file [" << fn << "]" << sync_endl;
+                            sync_cout << "info string Failed to save new experience entry to experience file [" << fn << "]" << sync_endl;
                             return false;
                         }
                     }
 
-                    sync_cout << "info string Saved " << _newPvExpEx.size() << " PV and " << _newMultiPvExpEx.size() << " MultiPV entries to experience file: " << fn << sync_endl;
+                    sync_cout << "info string Saved " << _savingPvExpEx.size() << " PV and " << _savingMultiPvExpEx.size() << " MultiPV entries to experience file: " << fn << sync_endl;
                 }
 
-                //Flush buffer
-                write_entry(nullptr, true);
+                //Flush last block
+                if (!writer.flush())
+                {
+                    sync_cout << "info string Failed to save experience entries to experience file [" << fn << "]" << sync_endl;
+                    return false;
+                }
 
                 //Clear new moves
-                clear_new_exp();
+                if (saveAll)
+                    clear_new_exp();
+                else
+                    clear_exp(_savingPvExpEx, _savingMultiPvExpEx);
 
                 return true;
             }
 
         public:
-            ExperienceData()
+            explicit ExperienceData(bool shareable = false, bool budgeted = false)
             {
+                _shareable = shareable;
+                _budgeted = budgeted;
+                _shared = nullptr;
                 _loading = false;
                 _abortLoading.store(false, memory_order_relaxed);
                 _loadingResult.store(false, memory_order_relaxed);
                 _loaderThread = nullptr;
             }
 
-            ~ExperienceData()
+            ~ExperienceData()
+            {
+                clear();
+            }
+
+            string filename() const
+            {
+                return _filename;
+            }
+
+            bool shareable() const
             {
-                clear();
+                return _shareable;
             }
 
-            string filename() const
+            const ExpMap& positions() const
             {
-                return _filename;
+                return _mainExp;
             }
 
             bool has_new_exp() const
             {
-                return _newPvExpEx.size() || _newMultiPvExpEx.size();
+                return _newPvExpEx.size() || _newMultiPvExpEx.size() || _savingPvExpEx.size() || _savingMultiPvExpEx.size();
             }
 
             bool load(string filename, bool synchronous)
@@ -816,6 +1899,9 @@ namespace Experience
                 _filename = filename;
                 _loadingResult.store(false, memory_order_relaxed);
 
+                //The budget depends on the threads, which may be resized while loading
+                _loadPolicy = RetentionPolicy::from_options(_budgeted);
+
                 //Block
                 {
                     _loading = true;
@@ -823,20 +1909,19 @@ namespace Experience
                     _loaderThread = new thread(thread([this, filename]()
                         {
                             //Load
-                            bool loadingResult = _load(filename);
+                            bool loadingResult = _shareable ? _load_shared(filename) : _load(filename);
                             _loadingResult.store(loadingResult, memory_order_relaxed);
 
                             //Notify
-                            {
-                                lock_guard<mutex> lg2(_loaderMutex);
-                                _loading = false;
-                                _loadingCond.notify_one();
-                            }
-                            
-                            //Detach and delete thread
+                            lock_guard<mutex> lg2(_loaderMutex);
+
+                            //Detach and delete thread before waking up waiters, which may delete 'this'
                             _loaderThread->detach();
                             delete _loaderThread;
                             _loaderThread = nullptr;
+
+                            _loading = false;
+                            _loadingCond.notify_all();
                         }));
                 }
 
@@ -855,15 +1940,41 @@ namespace Experience
                 return _loadingResult.load(memory_order_relaxed);
             }
 
+            void wait_for_save_finished()
+            {
+                if (_saverThread.joinable())
+                    _saverThread.join();
+            }
+
             void save(string fn, bool saveAll, bool ignoreLoadingCheck)
             {
                 //Make sure we are not already in the process of loading same/other experience file
                 if(!ignoreLoadingCheck)
                     wait_for_load_finished();
 
+                //Make sure the previous save has finished
+                wait_for_save_finished();
+
                 if (!has_new_exp() && (!saveAll || _mainExp.size() == 0))
                     return;
 
+                //Shared experience is read only, new experience goes to a per process log to be merged later
+                if (_shared && !saveAll)
+                    fn += "." + to_string(SharedExperience::process_id()) + ".log";
+
+                //New experience is appended by a background thread, so that the caller (i.e. the search, right before
+                //sending 'bestmove') does not wait for the disk. Entries of a failed save are retried with the next one.
+                if (!saveAll)
+                {
+                    _savingPvExpEx.insert(_savingPvExpEx.end(), _newPvExpEx.begin(), _newPvExpEx.end());
+                    _savingMultiPvExpEx.insert(_savingMultiPvExpEx.end(), _newMultiPvExpEx.begin(), _newMultiPvExpEx.end());
+                    _newPvExpEx.clear();
+                    _newMultiPvExpEx.clear();
+
+                    _saverThread = thread([this, fn]() { _save(fn, false); });
+                    return;
+                }
+
                 //Step 1: Create backup only if 'saveAll' is 'true'
                 string expFilename = Utility::map_path(fn);
                 string backupExpFilename;
@@ -912,7 +2023,10 @@ namespace Experience
 
             const ExpEntryEx* probe(Key k)
             {
-                ExpConstIterator itr = _mainExp.find(k);
+                if (_shared)
+                    return _shared->probe(k);
+
+                ExpIterator itr = _mainExp.find(k);
                 if (itr == _mainExp.end())
                     return nullptr;
 
@@ -921,6 +2035,26 @@ namespace Experience
                 return itr->second;
             }
 
+            void prefetch(Key k)
+            {
+                if (_shared)
+                {
+                    _shared->prefetch(k);
+                    return;
+                }
+
+                _mainExp.prefetch(k);
+            }
+
+            //Memory used by the loaded experience, new entries not included
+            size_t memory() const
+            {
+                if (_shared)
+                    return _shared->memory();
+
+                return _expExDataSize + _mainExp.memory();
+            }
+
             void add_pv_experience(Key k, Move m, Value v, Depth d)
             {
                 _newPvExpEx.emplace_back(new ExpEntryEx(k, m, v, d, 1));
@@ -950,16 +2084,17 @@ namespace Experience
         }
 
         string filename = Options["Experience File"];
+        bool shared = Options["Experience Shared"];
         if (currentExperience)
         {
-            if (currentExperience->filename() == filename && currentExperience->loading_result())
+            if (currentExperience->filename() == filename && currentExperience->shareable() == shared && currentExperience->loading_result())
                 return;
 
             if (currentExperience)
                 unload();
         }
 
-        currentExperience = new ExperienceData();
+        currentExperience = new ExperienceData(shared, true);
         currentExperience->load(filename, false);
     }
 
@@ -978,7 +2113,13 @@ namespace Experience
 
     void save()
     {
-        if (!currentExperience || !currentExperience->has_new_exp() || (bool)Options["Experience Readonly"])
+        if (!currentExperience)
+            return;
+
+        //The saver thread clears the pending entries, join it before looking at them
+        currentExperience->wait_for_save_finished();
+
+        if (!currentExperience->has_new_exp() || (bool)Options["Experience Readonly"])
             return;
 
         currentExperience->save(currentExperience->filename(), false, false);
@@ -986,7 +2127,12 @@ namespace Experience
 
     void reload()
     {
-        if (!currentExperience || !currentExperience->has_new_exp())
+        if (!currentExperience)
+            return;
+
+        currentExperience->wait_for_save_finished();
+
+        if (!currentExperience->has_new_exp())
             return;
 
         init();
@@ -1001,6 +2147,21 @@ namespace Experience
         return currentExperience->probe(k);
     }
 
+    void prefetch(Key k)
+    {
+        if (currentExperience)
+            currentExperience->prefetch(k);
+    }
+
+    size_t memory()
+    {
+        if (!currentExperience)
+            return 0;
+
+        currentExperience->wait_for_load_finished();
+        return currentExperience->memory();
+    }
+
     void wait_for_loading_finished()
     {
         if (!currentExperience)
@@ -1091,6 +2252,528 @@ namespace Experience
         exp.save(targetFilename, true, false);
     }
 
+    namespace
+    {
+        //Read only memory mapping of a whole file
+        class MappedFile
+        {
+        private:
+            uint8_t* _data = nullptr;
+            size_t   _size = 0;
+#ifdef _WIN32
+            HANDLE   _mapping = nullptr;
+#endif
+
+        public:
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator =(const MappedFile&) = delete;
+
+            explicit MappedFile(const string& filename)
+            {
+#ifndef _WIN32
+                int fd = ::open(filename.c_str(), O_RDONLY);
+                if (fd == -1)
+                    return;
+
+                struct stat statbuf;
+                if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0)
+                {
+                    void* p = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                    if (p != MAP_FAILED)
+                    {
+                        _data = (uint8_t*)p;
+                        _size = statbuf.st_size;
+#if defined(MADV_SEQUENTIAL)
+                        madvise(p, _size, MADV_SEQUENTIAL);
+#endif
+                    }
+                }
+
+                ::close(fd);
+#else
+                HANDLE fd = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                if (fd == INVALID_HANDLE_VALUE)
+                    return;
+
+                LARGE_INTEGER size;
+                if (GetFileSizeEx(fd, &size) && size.QuadPart > 0)
+                {
+                    _mapping = CreateFileMapping(fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (_mapping)
+                    {
+                        _data = (uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+                        _size = _data ? size_t(size.QuadPart) : 0;
+                    }
+                }
+
+                CloseHandle(fd);
+#endif
+            }
+
+            ~MappedFile()
+            {
+#ifndef _WIN32
+                if (_data)
+                    munmap(_data, _size);
+#else
+                if (_data)
+                    UnmapViewOfFile(_data);
+
+                if (_mapping)
+                    CloseHandle(_mapping);
+#endif
+            }
+
+            const uint8_t* data() const { return _data; }
+            size_t size() const { return _size; }
+        };
+    }
+
+    //Expstats command:
+    //Format:  expstats [filename]
+    //Example: expstats C:\Path to\Experience\file.exp
+    //Note:    The file is scanned in parallel without being loaded, in a bounded memory: large files are scanned again
+    //         for each range of keys. The command reports the distributions of depth, count, value and moves per
+    //         position, the fragmentation and the memory needed to load the file
+    void stats(int argc, char* argv[])
+    {
+        //Make sure experience has finished loading
+        //Not exactly needed here, but the messages shown when exp loading finish will
+        //disturb the output of this function
+        wait_for_loading_finished();
+
+        if (argc != 1)
+        {
+            sync_cout << "info string Error : Incorrect expstats command" << sync_endl;
+            sync_cout << "info string Syntax: expstats [filename]" << sync_endl;
+            return;
+        }
+
+        string filename = Utility::map_path(Utility::unquote(argv[0]));
+
+        TimePoint elapsed = now();
+
+        MappedFile file(filename);
+        if (!file.data())
+        {
+            sync_cout << "info string Could not open experience file: " << filename << sync_endl;
+            return;
+        }
+
+        //Detect version
+        auto has_signature = [&](const char* signature, size_t signatureLength) {
+            return file.size() >= signatureLength && memcmp(file.data(), signature, signatureLength) == 0;
+        };
+
+        int version = has_signature(V3::ExperienceSignature, V3::ExperienceSignatureLength) ? 3
+                    : has_signature(V2::ExperienceSignature, V2::ExperienceSignatureLength) ? 2
+                    : has_signature(V1::ExperienceSignature, V1::ExperienceSignatureLength) ? 1 : 0;
+
+        size_t signatureLength = version == 3 ? V3::ExperienceSignatureLength
+                               : version == 2 ? V2::ExperienceSignatureLength : V1::ExperienceSignatureLength;
+
+        //Work units are the blocks for V3, found by walking their headers, and the entries for older versions
+        vector<size_t> blocks;
+        size_t units = 0;
+
+        if (version == 3)
+        {
+            size_t pos = signatureLength;
+            V3::BlockHeader header;
+            while (file.size() - pos >= sizeof(V3::BlockHeader))
+            {
+                memcpy(&header, file.data() + pos, sizeof(header));
+                blocks.push_back(pos);
+                pos += sizeof(V3::BlockHeader) + header.size;
+
+                if (pos > file.size())
+                    break;
+            }
+
+            units = blocks.size();
+            if (pos != file.size())
+                version = 0;
+        }
+        else if (version)
+        {
+            units = (file.size() - signatureLength) / sizeof(V2::ExpEntry);
+            if (units * sizeof(V2::ExpEntry) != file.size() - signatureLength)
+                version = 0;
+        }
+
+        if (!version)
+        {
+            sync_cout << "info string The file [" << filename << "] is not a valid experience file" << sync_endl;
+            return;
+        }
+
+        //Histograms of counts and moves per position use power of two buckets
+        constexpr int LogBuckets = 17;
+        auto log_bucket = [](uint64_t v) { return v ? std::min(msb(v) + 1, LogBuckets - 1) : 0; };
+
+        //Value buckets (centipawns)
+        constexpr int ValueBounds[] = { -1000, -300, -100, -25, 25, 100, 300, 1000 };
+        constexpr int ValueBuckets = sizeof(ValueBounds) / sizeof(ValueBounds[0]) + 1;
+
+        struct KeyMove
+        {
+            Key      key;
+            uint32_t move;
+
+            bool operator<(const KeyMove& km) const { return key != km.key ? key < km.key : move < km.move; }
+        };
+
+        struct ScanData
+        {
+            uint64_t entries = 0;
+            uint64_t corruptBlocks = 0;
+            uint64_t positions = 0;
+            uint64_t uniqueMoves = 0;
+            uint64_t depth[MAX_PLY + 1] = {};
+            uint64_t count[LogBuckets] = {};
+            uint64_t value[ValueBuckets] = {};
+            uint64_t movesPerPosition[LogBuckets] = {};
+            vector<vector<KeyMove>> parts; //Keys and moves of the current key range, partitioned by worker
+        };
+
+        //Memory for the keys of one key range
+        constexpr uint64_t StatsMemory = 256 * 1024 * 1024;
+
+        size_t workers = std::max(size_t(1), std::min(size_t(thread::hardware_concurrency()), std::max(units, size_t(1))));
+        vector<ScanData> data(workers);
+
+        //Calls 'f' for each entry of the work units of worker 'w', adding the corrupt blocks to 'corruptBlocks'
+        auto for_each_entry = [&](size_t w, uint64_t& corruptBlocks, auto f)
+        {
+            Current::ExpEntry exp((Key)0, MOVE_NONE, VALUE_NONE, DEPTH_NONE);
+
+            for (size_t u = units * w / workers; u < units * (w + 1) / workers; ++u)
+            {
+                if (version == 3)
+                {
+                    V3::BlockHeader header;
+                    memcpy(&header, file.data() + blocks[u], sizeof(header));
+
+                    const uint8_t* cur = file.data() + blocks[u] + sizeof(header);
+                    const uint8_t* end = cur + header.size;
+
+                    if (V3::checksum(cur, header.size) != header.checksum)
+                    {
+                        ++corruptBlocks;
+                        continue;
+                    }
+
+                    Key prevKey = 0;
+                    for (uint32_t i = 0; i < header.count && V3::decode_entry(cur, end, prevKey, exp); ++i)
+                        f(exp);
+                }
+                else
+                {
+                    //V1 and V2 entries share the same layout, V1 has no count
+                    memcpy((void*)&exp, file.data() + signatureLength + u * sizeof(V2::ExpEntry), sizeof(V2::ExpEntry));
+                    if (version == 1)
+                        exp.count = 1;
+
+                    f(exp);
+                }
+            }
+        };
+
+        auto run = [&](const function<void(size_t)>& pass)
+        {
+            vector<thread> threads;
+            for (size_t w = 0; w < workers; ++w)
+                threads.emplace_back(pass, w);
+
+            for (thread& th : threads)
+                th.join();
+        };
+
+        //Step 1: Scan the work units in parallel, collecting the histograms
+        run([&](size_t w)
+        {
+            ScanData& sd = data[w];
+
+            for_each_entry(w, sd.corruptBlocks, [&](const Current::ExpEntry& exp)
+            {
+                ++sd.entries;
+                sd.depth[std::clamp(int(exp.depth), 0, int(MAX_PLY))]++;
+                sd.count[log_bucket(exp.count)]++;
+
+                int cp = exp.value * 100 / PawnValueEg;
+                sd.value[upper_bound(begin(ValueBounds), end(ValueBounds), cp) - begin(ValueBounds)]++;
+            });
+        });
+
+        //Step 2: Positions and unique moves are counted by sorting the keys. To bound the memory whatever the file
+        //size, the key space is split in ranges that are counted one after the other, each with a new scan of the
+        //file. Every range is split again between the workers, so that they can sort their part in parallel.
+        uint64_t entries = 0;
+        for (const ScanData& sd : data)
+            entries += sd.entries;
+
+        size_t passes = std::max(size_t(1), size_t(entries * sizeof(KeyMove) * 2 / StatsMemory + 1));
+
+        for (size_t p = 0; p < passes; ++p)
+        {
+            //Collect the keys of the range, by worker part
+            run([&](size_t w)
+            {
+                ScanData& sd = data[w];
+                sd.parts.resize(workers);
+
+                uint64_t corruptBlocks = 0; //Already counted
+                for_each_entry(w, corruptBlocks, [&](const Current::ExpEntry& exp)
+                {
+                    size_t g = mul_hi64(exp.key, passes * workers);
+                    if (g / workers == p)
+                        sd.parts[g % workers].push_back({ exp.key, uint32_t(exp.move) });
+                });
+            });
+
+            //Sort each part and count positions, unique moves and moves per position
+            run([&](size_t w)
+            {
+                ScanData& sd = data[w];
+
+                vector<KeyMove> keys;
+                for (ScanData& d : data)
+                {
+                    keys.insert(keys.end(), d.parts[w].begin(), d.parts[w].end());
+                    vector<KeyMove>().swap(d.parts[w]);
+                }
+
+                sort(keys.begin(), keys.end());
+
+                for (size_t i = 0; i < keys.size(); )
+                {
+                    size_t moves = 0;
+                    Key k = keys[i].key;
+
+                    for ( ; i < keys.size() && keys[i].key == k; ++i)
+                        if (i == 0 || keys[i - 1].key != k || keys[i - 1].move != keys[i].move)
+                            ++moves;
+
+                    ++sd.positions;
+                    sd.uniqueMoves += moves;
+                    sd.movesPerPosition[log_bucket(moves)]++;
+                }
+            });
+        }
+
+        //Merge results
+        ScanData total;
+        for (const ScanData& sd : data)
+        {
+            total.entries       += sd.entries;
+            total.corruptBlocks += sd.corruptBlocks;
+            total.positions     += sd.positions;
+            total.uniqueMoves   += sd.uniqueMoves;
+
+            for (int i = 0; i <= MAX_PLY; ++i)
+                total.depth[i] += sd.depth[i];
+
+            for (int i = 0; i < LogBuckets; ++i)
+            {
+                total.count[i] += sd.count[i];
+                total.movesPerPosition[i] += sd.movesPerPosition[i];
+            }
+
+            for (int i = 0; i < ValueBuckets; ++i)
+                total.value[i] += sd.value[i];
+        }
+
+        elapsed = now() - elapsed;
+
+        //Memory after loading, all the entries are kept (duplicates included)
+        auto [entriesMemory, mapMemory] = expected_memory(total.entries, total.positions);
+
+        auto percent = [&](uint64_t n, uint64_t outOf) {
+            ostringstream ss;
+            ss << fixed << setprecision(2) << (outOf ? 100.0 * n / outOf : 0.0) << "%";
+            return ss.str();
+        };
+
+        auto log_label = [](int b) {
+            return b <= 1 ? to_string(b) : b == LogBuckets - 1 ? to_string(1 << (b - 1)) + "+"
+                                         : to_string(1 << (b - 1)) + "-" + to_string((1 << b) - 1);
+        };
+
+        sync_cout << endl
+                  << "Experience file : " << filename << endl
+                  << "Version         : " << version << endl
+                  << "File size       : " << format_bytes(file.size(), 2) << endl
+                  << "Scan time       : " << elapsed << " ms (" << workers << " threads, " << passes + 1 << " scans)" << endl
+                  << "Total moves     : " << total.entries << endl
+                  << "Total positions : " << total.positions << endl
+                  << "Unique moves    : " << total.uniqueMoves << endl
+                  << "Duplicate moves : " << total.entries - total.uniqueMoves
+                  << " (fragmentation: " << percent(total.entries - total.uniqueMoves, total.entries) << ")" << endl;
+
+        if (version == 3)
+            cout << "Corrupt blocks  : " << total.corruptBlocks << " of " << blocks.size() << endl;
+
+        cout << "Expected RAM    : " << format_bytes(entriesMemory + mapMemory, 2)
+             << " (" << format_bytes(entriesMemory, 2) << " entries, " << format_bytes(mapMemory, 2) << " map"
+             << ", up to " << format_bytes(entriesMemory + mapMemory * 3 / 2, 2) << " while loading)" << endl;
+
+        cout << endl << "Depth:" << endl;
+        for (int i = 0; i <= MAX_PLY; ++i)
+            if (total.depth[i])
+                cout << "  " << setw(10) << left << i << ": " << setw(12) << total.depth[i] << percent(total.depth[i], total.entries) << endl;
+
+        cout << endl << "Count:" << endl;
+        for (int i = 0; i < LogBuckets; ++i)
+            if (total.count[i])
+                cout << "  " << setw(10) << left << log_label(i) << ": " << setw(12) << total.count[i] << percent(total.count[i], total.entries) << endl;
+
+        cout << endl << "Value (cp):" << endl;
+        for (int i = 0; i < ValueBuckets; ++i)
+        {
+            string label = i == 0                ? "< " + to_string(ValueBounds[0])
+                         : i == ValueBuckets - 1 ? ">= " + to_string(ValueBounds[i - 1])
+                                                 : to_string(ValueBounds[i - 1]) + " .. " + to_string(ValueBounds[i] - 1);
+
+            cout << "  " << setw(14) << left << label << ": " << setw(12) << total.value[i] << percent(total.value[i], total.entries) << endl;
+        }
+
+        cout << endl << "Moves per position:" << endl;
+        for (int i = 0; i < LogBuckets; ++i)
+            if (total.movesPerPosition[i])
+                cout << "  " << setw(10) << left << log_label(i) << ": " << setw(12) << total.movesPerPosition[i] << percent(total.movesPerPosition[i], total.positions) << endl;
+
+        cout << right << sync_endl;
+    }
+
+    //Expbench command:
+    //Format:  expbench [filename]
+    //Example: expbench C:\Path to\Experience\file.exp
+    //Note:    The positions of the file are inserted in the experience map (ExpKeyMap), in google::dense_hash_map and
+    //         in std::unordered_map. The command reports the build time, the time per probe of present and of absent
+    //         keys in random order, and the memory used by each map
+    void bench(int argc, char* argv[])
+    {
+        //Make sure experience has finished loading
+        //Not exactly needed here, but the messages shown when exp loading finish will
+        //disturb the output of this function
+        wait_for_loading_finished();
+
+        if (argc != 1)
+        {
+            sync_cout << "info string Error : Incorrect expbench command" << sync_endl;
+            sync_cout << "info string Syntax: expbench [filename]" << sync_endl;
+            return;
+        }
+
+        string filename = Utility::map_path(Utility::unquote(argv[0]));
+
+        ExperienceData exp;
+        if (!exp.load(filename, true))
+            return;
+
+        vector<ExpMap::value_type> items;
+        items.reserve(exp.positions().size());
+        for (auto& x : exp.positions())
+            items.push_back(x);
+
+        if (items.empty())
+            return;
+
+        //Present keys in random order, and random keys which are not present
+        PRNG rng(1070372);
+        vector<Key> hits, misses;
+        for (auto& x : items)
+            hits.push_back(x.first);
+
+        for (size_t i = hits.size() - 1; i > 0; --i)
+            swap(hits[i], hits[rng.rand<uint64_t>() % (i + 1)]);
+
+        while (misses.size() < hits.size())
+        {
+            Key k = rng.rand<Key>();
+            if (k && !exp.probe(k))
+                misses.push_back(k);
+        }
+
+        //Repeat the probes on small files, so that each measure is at least 'MinProbes' long
+        constexpr size_t MinProbes = 1 << 24;
+        size_t rounds = std::max(size_t(1), MinProbes / hits.size());
+
+        auto elapsed_ns = [](chrono::steady_clock::time_point start) {
+            return double(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        };
+
+        sync_cout << endl
+                  << "Experience file : " << filename << endl
+                  << "Positions       : " << items.size() << endl
+                  << "Probes          : " << rounds * hits.size() << " present, " << rounds * misses.size() << " absent" << endl
+                  << endl
+                  << left << setw(22) << "Map" << right
+                  << setw(12) << "Build (ms)" << setw(14) << "Present (ns)" << setw(14) << "Absent (ns)" << setw(14) << "Memory" << endl;
+
+        auto measure = [&](const char* name, auto& map, auto build, auto memory)
+        {
+            auto start = chrono::steady_clock::now();
+            build(map);
+            double buildNs = elapsed_ns(start);
+
+            auto probe = [&](const vector<Key>& keys, size_t& found) {
+                found = 0;
+                auto t = chrono::steady_clock::now();
+                for (size_t i = 0; i < rounds; ++i)
+                    for (Key k : keys)
+                        found += map.find(k) != map.end();
+
+                return elapsed_ns(t) / double(rounds * keys.size());
+            };
+
+            size_t foundHits, foundMisses;
+            double hitNs = probe(hits, foundHits);
+            double missNs = probe(misses, foundMisses);
+
+            cout << left << setw(22) << name << right << fixed
+                 << setw(12) << setprecision(1) << buildNs / 1e6
+                 << setw(14) << setprecision(1) << hitNs
+                 << setw(14) << setprecision(1) << missNs
+                 << setw(14) << format_bytes(memory(map), 2)
+                 << (foundHits != rounds * hits.size() || foundMisses ? "  (wrong results!)" : "") << endl;
+        };
+
+        {
+            ExpMap map;
+            measure("ExpKeyMap (insert)", map,
+                    [&](ExpMap& m) { for (auto& x : items) m[x.first] = x.second; },
+                    [](const ExpMap& m) { return m.memory(); });
+        }
+
+        {
+            ExpMap map;
+            vector<ExpMap::value_type> sorted = items;
+            measure("ExpKeyMap (bulk)", map,
+                    [&](ExpMap& m) { m.build(sorted); },
+                    [](const ExpMap& m) { return m.memory(); });
+        }
+
+        {
+            SugaRKeyMap<ExpEntryEx*> map;
+            measure("dense_hash_map", map,
+                    [&](SugaRKeyMap<ExpEntryEx*>& m) { for (auto& x : items) m[x.first] = x.second; },
+                    [](const SugaRKeyMap<ExpEntryEx*>& m) { return m.bucket_count() * sizeof(ExpMap::value_type); });
+        }
+
+        {
+            //Memory of the nodes is estimated: value, next pointer and cached hash
+            unordered_map<Key, ExpEntryEx*> map;
+            measure("unordered_map", map,
+                    [&](unordered_map<Key, ExpEntryEx*>& m) { for (auto& x : items) m[x.first] = x.second; },
+                    [](const unordered_map<Key, ExpEntryEx*>& m) {
+                        return m.bucket_count() * sizeof(void*) + m.size() * (sizeof(ExpMap::value_type) + sizeof(void*) + sizeof(size_t));
+                    });
+        }
+
+        cout << sync_endl;
+    }
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
     //Convert compact PGN data to experience entries
     //
@@ -1216,6 +2899,11 @@ namespace Experience
             globalConversionData.outputStream.write(Current::ExperienceSignature, Current::ExperienceSignatureLength);
             globalConversionData.outputStreamBase = globalConversionData.outputStream.tellp();
         }
+        else if (!Current::has_signature(outputPath))
+        {
+            sync_cout << "Cannot append to <" << outputPath << ">, it is not an experience file of the current version" << sync_endl;
+            return;
+        }
 
         //////////////////////////////////////////////////////////////////////////
         //Buffer
@@ -1227,7 +2915,19 @@ namespace Experience
         {
             if (force || globalConversionData.buffer.size() >= WriteBufferSize)
             {
-                globalConversionData.outputStream.write(globalConversionData.buffer.data(), globalConversionData.buffer.size());
+                //The buffer holds plain entries, write them as sorted blocks
+                const Current::ExpEntry* bufferedExp = reinterpret_cast<const Current::ExpEntry*>(globalConversionData.buffer.data());
+                vector<const Current::ExpEntry*> entries;
+                for (size_t i = 0; i < globalConversionData.buffer.size() / sizeof(Current::ExpEntry); ++i)
+                    entries.push_back(bufferedExp + i);
+
+                Current::sort_entries(entries);
+
+                Current::BlockWriter writer(globalConversionData.outputStream);
+                for (const Current::ExpEntry* exp : entries)
+                    writer.write(*exp);
+
+                writer.flush();
                 globalConversionData.buffer.clear();
 
                 size_t numMoves = globalConversionData.numMovesWithScores + globalConversionData.numMovesWithScoresIgnored + globalConversionData.numMovesWithoutScores;
@@ -1560,7 +3260,7 @@ namespace Experience
         while (temp)
         {
             quality.emplace_back(temp, temp->quality(pos, evalImportance).first);
-            temp = temp->next;
+            temp = temp->next();
         }
 
         //Sort experience moves based on quality
@@ -1594,7 +3294,7 @@ namespace Experience
 
             cout << endl;
 
-            expEx = expEx->next;
+            expEx = expEx->next();
         }
 
         cout << sync_endl;
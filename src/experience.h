@@ -149,12 +149,20 @@ namespace Experience
         static_assert(sizeof(ExpEntry) == 24);
     }
 
-    namespace Current = V2;
+    namespace V3
+    {
+        //V3 files store V2 entries, compressed in blocks (see experience.cpp)
+        using V2::ExpEntry;
+    }
+
+    namespace Current = V3;
 
     //Experience structure
     struct ExpEntryEx : public Current::ExpEntry
     {
-        ExpEntryEx* next = nullptr;
+        //Moves of a position are chained by byte offset rather than by pointer, so that the
+        //chains stay valid in memory shared by processes mapping it at different addresses
+        intptr_t nextOffset = 0;
 
         ExpEntryEx() = delete;
         ExpEntryEx(const ExpEntryEx& expEx) = delete;
@@ -162,6 +170,16 @@ namespace Experience
 
         explicit ExpEntryEx(Stockfish::Key k, Stockfish::Move m, Stockfish::Value v, Stockfish::Depth d, uint8_t c) : Current::ExpEntry(k, m, v, d, c) {}
 
+        ExpEntryEx* next() const
+        {
+            return nextOffset ? (ExpEntryEx*)(intptr_t(this) + nextOffset) : nullptr;
+        }
+
+        void set_next(const ExpEntryEx* expEx)
+        {
+            nextOffset = expEx ? intptr_t(expEx) - intptr_t(this) : 0;
+        }
+
         ExpEntryEx* find(Stockfish::Move m)
         {
             ExpEntryEx* expEx = this;
@@ -170,7 +188,7 @@ namespace Experience
                 if (expEx->move == m)
                     return expEx;
 
-                expEx = expEx->next;
+                expEx = expEx->next();
             } while (expEx);
 
             return nullptr;
@@ -190,11 +208,15 @@ namespace Experience
     void reload();
 
     void wait_for_loading_finished();
+    size_t memory();
 
     const ExpEntryEx* probe(Stockfish::Key k);
+    void prefetch(Stockfish::Key k);
 
     void defrag(int argc, char* argv[]);
     void merge(int argc, char* argv[]);
+    void stats(int argc, char* argv[]);
+    void bench(int argc, char* argv[]);
     void show_exp(Stockfish::Position& pos, bool extended);
     void convert_compact_pgn(int argc, char* argv[]);
 
@@ -0,0 +1,274 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPMAP_H_INCLUDED
+#define EXPMAP_H_INCLUDED
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(USE_AVX2)
+#include <immintrin.h>
+#elif defined(USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#include "bitboard.h"
+#include "misc.h"
+#include "types.h"
+
+namespace Experience {
+
+/// ExpKeyMap is an open addressing hash map from Zobrist keys to values, in the
+/// style of a Swiss table. The slots are split in groups, with one control byte
+/// per slot holding either Empty or the top 7 bits of the key of the slot. A
+/// lookup compares the control bytes of a whole group at once (32 with AVX2,
+/// 16 otherwise) and only reads the keys of the slots that match. Zobrist keys
+/// are random, so the low bits of the key pick the first group to look at.
+/// Key 0 cannot be stored and entries are never erased.
+
+template<typename T>
+class ExpKeyMap {
+
+public:
+  typedef std::pair<Stockfish::Key, T> value_type;
+
+#if defined(USE_AVX2)
+  static constexpr size_t GroupWidth = 32;
+#else
+  static constexpr size_t GroupWidth = 16;
+#endif
+
+  // Maximum load factor is 7/8
+  static size_t capacity_for(size_t n) {
+    size_t groups = 1;
+    while (groups * GroupWidth * 7 / 8 < n)
+        groups *= 2;
+
+    return n ? groups * GroupWidth : 0;
+  }
+
+  static size_t memory_for(size_t n) {
+    return capacity_for(n) * (sizeof(value_type) + 1);
+  }
+
+  template<typename Map, typename V>
+  class Iterator {
+
+    friend class ExpKeyMap;
+
+    Map* map;
+    size_t idx;
+
+    Iterator(Map* m, size_t i) : map(m), idx(i) {}
+
+    void skip_empty() {
+      while (idx < map->cap && map->ctrl[idx] == Empty)
+          ++idx;
+    }
+
+  public:
+    V& operator*() const { return map->slots[idx]; }
+    V* operator->() const { return &map->slots[idx]; }
+    Iterator& operator++() { ++idx; skip_empty(); return *this; }
+    bool operator==(const Iterator& it) const { return idx == it.idx; }
+    bool operator!=(const Iterator& it) const { return idx != it.idx; }
+  };
+
+  typedef Iterator<ExpKeyMap, value_type> iterator;
+  typedef Iterator<const ExpKeyMap, const value_type> const_iterator;
+
+  ExpKeyMap() = default;
+  ExpKeyMap(const ExpKeyMap&) = delete;
+  ExpKeyMap& operator=(const ExpKeyMap&) = delete;
+  ~ExpKeyMap() { clear(); }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  size_t bucket_count() const { return cap; }
+  size_t memory() const { return cap * (sizeof(value_type) + 1); }
+
+  iterator begin() { iterator it(this, 0); it.skip_empty(); return it; }
+  iterator end() { return iterator(this, cap); }
+  const_iterator begin() const { const_iterator it(this, 0); it.skip_empty(); return it; }
+  const_iterator end() const { return const_iterator(this, cap); }
+
+  iterator find(Stockfish::Key k) { return iterator(this, lookup(k)); }
+  const_iterator find(Stockfish::Key k) const { return const_iterator(this, lookup(k)); }
+
+  T& operator[](Stockfish::Key k) {
+
+    size_t i = lookup(k);
+    if (i != cap)
+        return slots[i].second;
+
+    if (count + 1 > cap * 7 / 8)
+        rehash(capacity_for(count + 1));
+
+    return slots[insert_new(k, T())].second;
+  }
+
+  void reserve(size_t n) {
+    if (n > cap * 7 / 8)
+        rehash(capacity_for(n));
+  }
+
+  void resize(size_t n) { reserve(n); }
+
+  // Bulk build from distinct keys. The items are sorted by their first group,
+  // so that the table is filled front to back instead of at random places.
+  void build(std::vector<value_type>& items) {
+
+    clear();
+    rehash(capacity_for(items.size()));
+
+    std::sort(items.begin(), items.end(), [&](const value_type& a, const value_type& b) {
+        return home(a.first) < home(b.first);
+    });
+
+    for (value_type& v : items)
+        insert_new(v.first, v.second);
+  }
+
+  void clear() {
+    Stockfish::std_aligned_free(ctrl);
+    ctrl = nullptr;
+    slots = nullptr;
+    cap = count = groupMask = 0;
+  }
+
+  void swap(ExpKeyMap& m) {
+    std::swap(ctrl, m.ctrl);
+    std::swap(slots, m.slots);
+    std::swap(cap, m.cap);
+    std::swap(count, m.count);
+    std::swap(groupMask, m.groupMask);
+  }
+
+  void prefetch(Stockfish::Key k) const {
+    if (cap)
+    {
+        Stockfish::prefetch(ctrl + home(k) * GroupWidth);
+        Stockfish::prefetch(slots + home(k) * GroupWidth);
+    }
+  }
+
+private:
+  static constexpr uint8_t Empty = 0x80;
+
+  uint8_t* ctrl = nullptr;      // cap control bytes, followed by the slots
+  value_type* slots = nullptr;
+  size_t cap = 0;
+  size_t count = 0;
+  size_t groupMask = 0;
+
+  size_t home(Stockfish::Key k) const { return size_t(k) & groupMask; }
+  static uint8_t tag(Stockfish::Key k) { return uint8_t(k >> 57); }
+
+  // Bit i is set if control byte i of the group equals 'c'
+  static uint32_t match(const uint8_t* group, uint8_t c) {
+#if defined(USE_AVX2)
+    __m256i g = _mm256_load_si256((const __m256i*)group);
+    return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_set1_epi8(char(c)))));
+#elif defined(USE_SSE2)
+    __m128i g = _mm_load_si128((const __m128i*)group);
+    return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(char(c)))));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < GroupWidth; ++i)
+        m |= uint32_t(group[i] == c) << i;
+    return m;
+#endif
+  }
+
+  // Groups are visited with triangular steps, which reach all of them since
+  // their number is a power of two. A group with an empty slot ends the search.
+  size_t lookup(Stockfish::Key k) const {
+
+    if (!cap)
+        return cap;
+
+    size_t g = home(k);
+    for (size_t step = 1; ; g = (g + step++) & groupMask)
+    {
+        const uint8_t* group = ctrl + g * GroupWidth;
+
+        for (uint32_t m = match(group, tag(k)); m; m &= m - 1)
+        {
+            size_t i = g * GroupWidth + size_t(Stockfish::lsb(m));
+            if (slots[i].first == k)
+                return i;
+        }
+
+        if (match(group, Empty))
+            return cap;
+    }
+  }
+
+  size_t insert_new(Stockfish::Key k, const T& v) {
+
+    assert(k && count < cap);
+
+    size_t g = home(k);
+    for (size_t step = 1; ; g = (g + step++) & groupMask)
+    {
+        uint32_t m = match(ctrl + g * GroupWidth, Empty);
+        if (m)
+        {
+            size_t i = g * GroupWidth + size_t(Stockfish::lsb(m));
+            ctrl[i] = tag(k);
+            new (&slots[i]) value_type(k, v);
+            ++count;
+            return i;
+        }
+    }
+  }
+
+  void rehash(size_t newCap) {
+
+    ExpKeyMap m;
+    m.cap = newCap;
+    m.groupMask = newCap / GroupWidth - 1;
+    m.ctrl = (uint8_t*)Stockfish::std_aligned_alloc(64, newCap * (sizeof(value_type) + 1));
+    if (!m.ctrl)
+    {
+        std::cerr << "Failed to allocate " << newCap * (sizeof(value_type) + 1)
+                  << " bytes for experience map." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    m.slots = (value_type*)(m.ctrl + newCap);
+    std::memset(m.ctrl, Empty, newCap);
+
+    for (size_t i = 0; i < cap; ++i)
+        if (ctrl[i] != Empty)
+            m.insert_new(slots[i].first, slots[i].second);
+
+    swap(m);
+  }
+};
+
+} // namespace Experience
+
+#endif // #ifndef EXPMAP_H_INCLUDED
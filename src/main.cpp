@@ -19,6 +19,7 @@
 #include <iostream>
 
 #include "bitboard.h"
+#include "cluster.h"
 #include "endgame.h"
 #include "misc.h"
 #include "polybook.h"
@@ -26,6 +27,7 @@
 #include "psqt.h"
 #include "search.h"
 #include "syzygy/tbprobe.h"
+#include "telemetry.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
@@ -69,6 +71,8 @@ int main(int argc, char* argv[]) {
 
   UCI::loop(argc, argv);
 
+  Cluster::exit();
+  Telemetry::stop();
   Experience::unload();
   Threads.set(0);
   return 0;
@@ -0,0 +1,209 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__linux__)
+#include <fstream>
+#include <unistd.h>
+#endif
+
+#include "memory.h"
+#include "polybook.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+#include "syzygy/tbprobe.h"
+#include "experience.h"
+
+namespace Stockfish::Memory {
+
+namespace {
+
+  const char* Names[] = { "Hash", "Threads", "Network", "Books", "Experience",
+                          "TB block caches", "TB files (not charged)" };
+
+  // Sizes in MB of what is charged against the budget regardless of the policy
+  int64_t fixed_mb() {
+    return int64_t(usage(Threads) + usage(Network) + usage(Books) + usage(TBCache)) >> 20;
+  }
+
+  bool hash_first() { return Options["Memory Policy"] == "Hash"; }
+
+} // namespace
+
+
+/// usage() returns the number of bytes currently used by a subsystem
+
+size_t usage(Category c) {
+
+  size_t bytes = 0;
+
+  switch (c)
+  {
+  case Hash:
+      return TT.memory();
+
+  case Threads:
+      for (Thread* th : Stockfish::Threads)
+          bytes +=  (th == Stockfish::Threads.main() ? sizeof(MainThread) : sizeof(Thread))
+                  + th->pawnsTable.memory() + th->materialTable.memory() + th->hybridTable.memory();
+      return bytes;
+
+  case Network:
+      return Eval::NNUE::memory();
+
+  case Books:
+      return polybook[0].memory() + polybook[1].memory();
+
+  case Experience:
+      return ::Experience::memory();
+
+  case TBCache:
+      for (Thread* th : Stockfish::Threads)
+          bytes += th->tbCache.memory();
+      return bytes;
+
+  case TBFiles:
+      return Tablebases::mapped_memory();
+
+  default:
+      return 0;
+  }
+}
+
+
+/// resident() returns the resident set size of the process as seen by the OS,
+/// or 0 if it is not known.
+
+size_t resident() {
+
+#if defined(__linux__)
+  size_t pages = 0, residentPages = 0;
+  std::ifstream("/proc/self/statm") >> pages >> residentPages;
+  return residentPages * size_t(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+
+/// hash_size() returns the size in MB of the hash: the 'Hash' option, reduced
+/// if needed to fit in the budget. It is at least 1 MB.
+
+size_t hash_size() {
+
+  int64_t hash = int64_t(Options["Hash"]), budget = int64_t(Options["Memory Budget"]);
+
+  if (!budget)
+      return size_t(hash);
+
+  int64_t available = budget - fixed_mb();
+
+  if (!hash_first())
+      available -= int64_t(usage(Experience) >> 20);
+
+  return size_t(std::clamp(available, int64_t(1), hash));
+}
+
+
+/// experience_size() returns the size in MB the experience may use, 0 if it is
+/// not limited by the budget. With the 'Hash' policy the experience gets what
+/// the hash leaves, otherwise everything but the smallest possible hash.
+
+size_t experience_size() {
+
+  int64_t budget = int64_t(Options["Memory Budget"]);
+
+  if (!budget)
+      return 0;
+
+  int64_t available = budget - fixed_mb() - (hash_first() ? int64_t(hash_size()) : 1);
+
+  return size_t(std::max(available, int64_t(1)));
+}
+
+
+/// resize_hash() resizes the hash to hash_size(), telling the GUI when the
+/// budget does not allow the requested size.
+
+void resize_hash() {
+
+  size_t mb = hash_size();
+
+  if (mb < size_t(Options["Hash"]))
+      sync_cout << "info string Memory Budget limits Hash to " << mb << " MB" << sync_endl;
+
+  TT.resize(mb);
+}
+
+
+/// apply() resizes the hash if the budget, the policy or the fixed costs have
+/// changed its allowed size. The experience follows at its next load.
+
+void apply() {
+
+  if (hash_size() != TT.memory() >> 20)
+      resize_hash();
+}
+
+
+/// report() returns the breakdown of the memory use for the 'memory' command
+
+std::string report() {
+
+  std::stringstream ss;
+  size_t total = 0;
+
+  ss << std::fixed << std::setprecision(1);
+
+  for (int c = 0; c < CATEGORY_NB; ++c)
+  {
+      size_t bytes = usage(Category(c));
+      ss << std::left << std::setw(24) << Names[c]
+         << std::right << std::setw(10) << bytes / 1048576.0 << " MB\n";
+
+      if (c != TBFiles)
+          total += bytes;
+  }
+
+  ss << std::left << std::setw(24) << "Total charged"
+     << std::right << std::setw(10) << total / 1048576.0 << " MB\n";
+
+  size_t rss = resident();
+  ss << std::left << std::setw(24) << "Resident (OS)" << std::right << std::setw(10);
+  if (rss)
+      ss << rss / 1048576.0 << " MB\n";
+  else
+      ss << "N/A" << "\n";
+
+  int budget = int(Options["Memory Budget"]);
+  ss << "Budget: ";
+  if (budget)
+      ss << budget << " MB, policy " << std::string(Options["Memory Policy"])
+         << ", hash " << hash_size() << " of " << int(Options["Hash"]) << " MB"
+         << ", experience up to " << experience_size() << " MB";
+  else
+      ss << "none";
+
+  return ss.str();
+}
+
+} // namespace Stockfish::Memory
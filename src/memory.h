@@ -0,0 +1,46 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORY_H_INCLUDED
+#define MEMORY_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace Stockfish::Memory {
+
+/// Memory accounts for the large allocations of the engine, by subsystem, and
+/// applies the 'Memory Budget' option. Threads, the network, the books and the
+/// TB block caches are fixed costs. What remains of the budget is shared by the
+/// hash and the experience, the 'Memory Policy' option deciding which of them
+/// is served first. Mapped tablebase files are reported but not charged, since
+/// the OS can drop their pages at any time.
+
+enum Category { Hash, Threads, Network, Books, Experience, TBCache, TBFiles, CATEGORY_NB };
+
+size_t usage(Category c);
+size_t resident();
+size_t hash_size();
+size_t experience_size();
+void resize_hash();
+void apply();
+std::string report();
+
+} // namespace Stockfish::Memory
+
+#endif // #ifndef MEMORY_H_INCLUDED
@@ -0,0 +1,345 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// microbench.cpp is the main() of the 'sugar-microbench' binary built by
+/// 'make microbench'. It times the hot primitives of the engine one at a time
+/// on the bench positions and on the positions one move after them:
+///
+/// sugar-microbench [repetitions] [filter] [book=<file>] [exp=<file>]
+///
+/// Every primitive runs once as warmup, which also sizes the repetitions to
+/// about 20 ms, and then 'repetitions' times (default 20). The time per call
+/// is reported as the minimum, median and mean over the repetitions, with the
+/// standard deviation relative to the mean. Only the primitives whose name
+/// contains 'filter' are run. The book and experience probes need a file.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "endgame.h"
+#include "evaluate.h"
+#include "misc.h"
+#include "movegen.h"
+#include "polybook.h"
+#include "position.h"
+#include "psqt.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+#include "nnue/evaluate_nnue.h"
+#include "experience.h"
+
+using namespace Stockfish;
+using namespace std;
+
+namespace Stockfish {
+  vector<string> setup_bench(const Position&, istream&);
+}
+
+namespace {
+
+  constexpr double RepetitionNs = 20e6;
+
+  uint64_t sink; // Results are added here, so that no call can be optimized away
+
+  struct Corpus {
+    deque<StateInfo> states;
+    deque<Position> roots, children;
+    vector<vector<Move>> moves; // Legal moves of each root
+    vector<Key> keys; // Of the roots and the children
+  };
+
+  // The bench positions come from setup_bench(), the same list 'bench' uses
+  void load_corpus(Corpus& c) {
+
+    Position tmp;
+    StateInfo st;
+    tmp.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", false, &st, Threads.main());
+
+    istringstream args("16 1 1 default depth");
+    bool chess960 = false;
+
+    for (const string& cmd : setup_bench(tmp, args))
+    {
+        if (cmd.find("UCI_Chess960") != string::npos)
+            chess960 = cmd.find("value true") != string::npos;
+
+        if (cmd.find("position fen ") != 0)
+            continue;
+
+        c.states.emplace_back();
+        c.roots.emplace_back();
+        c.roots.back().set(cmd.substr(13), chess960, &c.states.back(), Threads.main());
+    }
+
+    for (Position& pos : c.roots)
+    {
+        c.keys.push_back(pos.key());
+        c.moves.emplace_back();
+
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            c.moves.back().push_back(m);
+
+            StateInfo s;
+            pos.do_move(m, s);
+
+            c.states.emplace_back();
+            c.children.emplace_back();
+            c.children.back().set(pos.fen(), pos.is_chess960(), &c.states.back(), Threads.main());
+            c.keys.push_back(pos.key());
+
+            pos.undo_move(m);
+        }
+    }
+
+    // Shuffle the keys, so that consecutive probes do not hit the same cache lines
+    PRNG rng(1070372);
+    for (size_t i = c.keys.size() - 1; i > 0; --i)
+        swap(c.keys[i], c.keys[rng.rand<uint64_t>() % (i + 1)]);
+  }
+
+  // measure() runs 'pass' once as warmup and then 'reps' times, where 'pass'
+  // does one sweep over the corpus and returns the number of calls it made.
+
+  void measure(const string& name, int reps, const function<size_t()>& pass) {
+
+    auto elapsed_ns = [](chrono::steady_clock::time_point start) {
+        return double(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    };
+
+    auto start = chrono::steady_clock::now();
+    size_t calls = pass();
+    double warmupNs = elapsed_ns(start);
+
+    size_t sweeps = max(size_t(1), size_t(RepetitionNs / max(warmupNs, 1.0)));
+    vector<double> ns;
+
+    for (int r = 0; r < reps; ++r)
+    {
+        start = chrono::steady_clock::now();
+        for (size_t s = 0; s < sweeps; ++s)
+            pass();
+
+        ns.push_back(elapsed_ns(start) / double(sweeps * max(calls, size_t(1))));
+    }
+
+    sort(ns.begin(), ns.end());
+
+    double mean = 0, var = 0;
+    for (double v : ns)
+        mean += v / ns.size();
+    for (double v : ns)
+        var += (v - mean) * (v - mean) / ns.size();
+
+    double median = ns.size() % 2 ? ns[ns.size() / 2] : (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]) / 2;
+
+    cout << left << setw(44) << name << right << fixed
+         << setw(10) << sweeps * calls
+         << setw(11) << setprecision(1) << ns.front()
+         << setw(11) << setprecision(1) << median
+         << setw(11) << setprecision(1) << mean
+         << setw(9)  << setprecision(1) << (mean > 0 ? 100 * sqrt(var) / mean : 0.0) << "%" << endl;
+  }
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+
+  CommandLine::init(argc, argv);
+  UCI::init(Options);
+  Tune::init();
+  PSQT::init();
+  Bitboards::init();
+  Position::init();
+  Bitbases::init();
+  Endgames::init();
+  Options["Experience Readonly"] = string("true");
+  Experience::init();
+  Threads.set(1);
+  Search::clear();
+  Eval::NNUE::init();
+
+  int reps = 20;
+  string filter;
+
+  for (int i = 1; i < argc; ++i)
+  {
+      string arg = argv[i];
+
+      if (arg.find("book=") == 0)
+          Options["Book1 File"] = arg.substr(5);
+      else if (arg.find("exp=") == 0)
+          Options["Experience File"] = arg.substr(4);
+      else if (!arg.empty() && all_of(arg.begin(), arg.end(), ::isdigit))
+          reps = max(1, stoi(arg));
+      else
+          filter = arg;
+  }
+
+  Experience::wait_for_loading_finished();
+
+  Corpus c;
+  load_corpus(c);
+
+  cout << "\nPositions : " << c.roots.size() << " bench positions, " << c.children.size() << " after one move"
+       << "\nRepeats   : " << reps << "\n\n"
+       << left << setw(44) << "Primitive" << right
+       << setw(10) << "Calls/rep" << setw(11) << "Min (ns)" << setw(11) << "Median" << setw(11) << "Mean"
+       << setw(10) << "Stddev" << endl;
+
+  auto run = [&](const string& name, const function<size_t()>& pass) {
+      if (name.find(filter) != string::npos)
+          measure(name, reps, pass);
+  };
+
+  run("Position::do_move + undo_move", [&]() {
+      size_t n = 0;
+      StateInfo st;
+      for (size_t i = 0; i < c.roots.size(); ++i)
+          for (Move m : c.moves[i])
+          {
+              Position& pos = c.roots[i];
+              pos.do_move(m, st);
+              sink += pos.key();
+              pos.undo_move(m);
+              ++n;
+          }
+      return n;
+  });
+
+  run("MoveList<LEGAL>", [&]() {
+      size_t n = 0;
+      for (Position& pos : c.children)
+      {
+          sink += MoveList<LEGAL>(pos).size();
+          ++n;
+      }
+      return n;
+  });
+
+  run("Position::see_ge", [&]() {
+      size_t n = 0;
+      for (size_t i = 0; i < c.roots.size(); ++i)
+          for (Move m : c.moves[i])
+          {
+              sink += c.roots[i].see_ge(m);
+              ++n;
+          }
+      return n;
+  });
+
+  // About half of the keys are stored, so that both hits and misses are probed
+  for (size_t i = 0; i < c.keys.size(); i += 2)
+  {
+      bool found;
+      TT.probe(c.keys[i], found)->save(c.keys[i], VALUE_ZERO, false, BOUND_EXACT, 1, MOVE_NONE, VALUE_ZERO);
+  }
+
+  run("TranspositionTable::probe", [&]() {
+      bool found;
+      for (Key k : c.keys)
+          sink += TT.probe(k, found) != nullptr && found;
+      return c.keys.size();
+  });
+
+  if (Experience::enabled() && Experience::memory())
+      run("Experience::probe", [&]() {
+          for (Key k : c.keys)
+              sink += Experience::probe(k) != nullptr;
+          return c.keys.size();
+      });
+
+  if (polybook[0].memory())
+      run("PolyBook::probe", [&]() {
+          for (Position& pos : c.roots)
+              sink += polybook[0].probe(pos, true);
+          return c.roots.size();
+      });
+
+  using namespace Eval::NNUE;
+
+  alignas(CacheLineSize) TransformedFeatureType transformed[FeatureTransformer::BufferSize];
+  alignas(CacheLineSize) char buffer[Network::BufferSize];
+
+  auto bucket = [](const Position& pos) { return (pos.count<ALL_PIECES>() - 1) / 4; };
+
+  // The accumulator of a position without parent is always refreshed
+  run("FeatureTransformer::transform (refresh)", [&]() {
+      for (Position& pos : c.roots)
+      {
+          pos.state()->accumulator.state[WHITE] = pos.state()->accumulator.state[BLACK] = INIT;
+          sink += featureTransformer->transform(pos, transformed, bucket(pos)).first;
+      }
+      return c.roots.size();
+  });
+
+  // After a move the accumulator is updated from the one of the parent. The
+  // time includes do_move() and undo_move(), measured above on their own.
+  run("FeatureTransformer::transform (update)", [&]() {
+      size_t n = 0;
+      StateInfo st;
+      for (size_t i = 0; i < c.roots.size(); ++i)
+      {
+          Position& pos = c.roots[i];
+          featureTransformer->transform(pos, transformed, bucket(pos));
+
+          for (Move m : c.moves[i])
+          {
+              pos.do_move(m, st);
+              sink += featureTransformer->transform(pos, transformed, bucket(pos)).first;
+              pos.undo_move(m);
+              ++n;
+          }
+      }
+      return n;
+  });
+
+  // The layers after the transformer, on the inputs of the non lazy positions
+  constexpr size_t InputSize = FeatureTransformer::BufferSize;
+  auto* inputs = static_cast<TransformedFeatureType*>(std_aligned_alloc(CacheLineSize, c.children.size() * InputSize));
+  vector<int> buckets;
+
+  for (Position& pos : c.children)
+      if (!featureTransformer->transform(pos, inputs + buckets.size() * InputSize, bucket(pos)).second)
+          buckets.push_back(bucket(pos));
+
+  run("Network::propagate", [&]() {
+      for (size_t i = 0; i < buckets.size(); ++i)
+          sink += network[buckets[i]]->propagate(inputs + i * InputSize, buffer)[0];
+      return buckets.size();
+  });
+
+  std_aligned_free(inputs);
+
+  cout << "\n(checksum " << sink % 1000 << ")" << endl;
+
+  Threads.set(0);
+  return 0;
+}
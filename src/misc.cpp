@@ -40,6 +40,8 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <functional>
 #include <iomanip>
@@ -47,7 +49,9 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <sstream>
 #include <vector>
 #include <bitset>
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <regex>
 
 #ifdef __GNUC__
@@ -63,6 +67,11 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #if defined(__linux__) && !defined(__ANDROID__)
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) || defined(__e2k__)
@@ -1370,6 +1379,235 @@ void bindThisThread(size_t idx) {
 
 } // namespace WinProcGroup
 
+
+namespace CpuPlacement {
+
+std::atomic<Policy> policy { None };
+
+void set_policy(const std::string& name) {
+
+  policy = name == "Cores" ? Cores : name == "Siblings" ? Siblings : None;
+}
+
+#if !defined(__linux__) || defined(__ANDROID__)
+
+void bindThisThread(size_t) {}
+
+#else
+
+/// Topology holds the processors the process may run on, grouped by physical
+/// core, and the order in which each policy hands them out to threads.
+
+struct Topology {
+
+  cpu_set_t processMask;
+  std::vector<int> order[3];
+
+  Topology() {
+
+      sched_getaffinity(0, sizeof(processMask), &processMask);
+
+      // Group the allowed processors by (package, core) from sysfs
+      std::vector<std::pair<std::pair<int, int>, std::vector<int>>> cores;
+
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      {
+          if (!CPU_ISSET(cpu, &processMask))
+              continue;
+
+          std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+          int package = -1, core = cpu;
+          std::ifstream(dir + "physical_package_id") >> package;
+          std::ifstream(dir + "core_id") >> core;
+
+          auto it = std::find_if(cores.begin(), cores.end(), [&](const auto& c) {
+              return c.first == std::make_pair(package, core);
+          });
+
+          if (it == cores.end())
+              cores.push_back({ { package, core }, { cpu } });
+          else
+              it->second.push_back(cpu);
+      }
+
+      size_t maxSiblings = 0;
+      for (const auto& c : cores)
+      {
+          maxSiblings = std::max(maxSiblings, c.second.size());
+          order[Siblings].insert(order[Siblings].end(), c.second.begin(), c.second.end());
+      }
+
+      for (size_t s = 0; s < maxSiblings; ++s)
+          for (const auto& c : cores)
+              if (s < c.second.size())
+                  order[Cores].push_back(c.second[s]);
+  }
+};
+
+void bindThisThread(size_t idx) {
+
+  static Topology topology; // Read once, before any thread has been pinned
+
+  Policy p = policy;
+  const std::vector<int>& cpus = topology.order[p];
+
+  if (p == None || cpus.empty())
+  {
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &topology.processMask);
+      return;
+  }
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpus[idx % cpus.size()], &mask);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+}
+
+#endif
+
+} // namespace CpuPlacement
+
+
+namespace PerfCounters {
+
+Sample& Sample::operator+=(const Sample& s) {
+
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      count[e] += s.count[e];
+      available[e] = available[e] || s.available[e];
+  }
+  return *this;
+}
+
+Sample Sample::operator-(const Sample& s) const {
+
+  Sample d;
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      d.available[e] = available[e];
+      d.count[e] = count[e] > s.count[e] ? count[e] - s.count[e] : 0;
+  }
+  return d;
+}
+
+std::atomic<int> openErrno { 0 };
+
+#if !defined(__linux__) || defined(__ANDROID__)
+
+void Group::open() {}
+void Group::close() {}
+Sample Group::read() const { return Sample(); }
+
+std::string error() { return "hardware counters are supported only on Linux"; }
+
+#else
+
+void Group::open() {
+
+  constexpr uint64_t Cache = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+
+  const std::pair<uint32_t, uint64_t> events[EVENT_NB] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | Cache },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | Cache },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | Cache },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+  };
+
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      if (fd[e] != -1)
+          continue;
+
+      // The events are not grouped, so that the kernel can multiplex them on
+      // CPUs with few counters. read() scales the counts by the running time.
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[e].first;
+      attr.config = events[e].second;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      fd[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fd[e] == -1)
+          openErrno = errno;
+  }
+}
+
+void Group::close() {
+
+  for (int e = 0; e < EVENT_NB; ++e)
+      if (fd[e] != -1)
+      {
+          ::close(fd[e]);
+          fd[e] = -1;
+      }
+}
+
+Sample Group::read() const {
+
+  Sample s;
+
+  for (int e = 0; e < EVENT_NB; ++e)
+  {
+      uint64_t buf[3]; // value, time enabled, time running
+
+      if (fd[e] == -1 || ::read(fd[e], buf, sizeof(buf)) != sizeof(buf))
+          continue;
+
+      s.available[e] = true;
+      s.count[e] = buf[2] ? uint64_t(double(buf[0]) * buf[1] / buf[2]) : 0;
+  }
+
+  return s;
+}
+
+std::string error() {
+
+  int err = openErrno;
+  if (!err)
+      return "";
+
+  std::string msg = std::strerror(err);
+  if (err == EACCES || err == EPERM)
+      msg += " (see /proc/sys/kernel/perf_event_paranoid)";
+  else if (err == ENOENT || err == EOPNOTSUPP)
+      msg += " (no hardware counters, as in most virtual machines)";
+
+  return msg;
+}
+
+#endif
+
+std::string rates(const Sample& s) {
+
+  if (!s.available[Instructions] || !s.count[Instructions])
+      return "n/a";
+
+  std::stringstream ss;
+  double kinstr = s.count[Instructions] / 1000.0;
+
+  ss << std::fixed << std::setprecision(2);
+
+  if (s.available[Cycles] && s.count[Cycles])
+      ss << "IPC " << double(s.count[Instructions]) / s.count[Cycles] << ", ";
+
+  ss << "misses/kinstr:";
+
+  const char* names[EVENT_NB] = { "", "", "L1D", "LLC", "dTLB", "branch" };
+  for (int e = L1DMisses; e < EVENT_NB; ++e)
+      if (s.available[e])
+          ss << " " << names[e] << " " << s.count[e] / kinstr;
+
+  return ss.str();
+}
+
+} // namespace PerfCounters
+
 #ifdef _WIN32
 #include <direct.h>
 #define GETCWD _getcwd
@@ -70,9 +70,15 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+inline int64_t now_us() { // Same clock as now(), in microseconds
+  return std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  size_t memory() const { return table.size() * sizeof(Entry); }
 
 private:
   std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
@@ -212,6 +218,54 @@ namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
 
+/// CpuPlacement pins search threads to logical processors on Linux. With the
+/// Cores policy thread i goes to the i-th physical core, and only when all the
+/// cores are used to their SMT siblings. With Siblings the threads fill one
+/// core after the other, so that consecutive threads share the L1/L2 caches.
+/// With None the threads can run on any processor of the process.
+
+namespace CpuPlacement {
+  enum Policy { None, Cores, Siblings };
+
+  void set_policy(const std::string& name);
+  void bindThisThread(size_t idx);
+}
+
+/// PerfCounters reads the hardware performance counters of a thread through
+/// perf_event_open (Linux only). A Group counts cycles, instructions, L1 data
+/// cache, last level cache, data TLB and branch misses of the thread that
+/// opened it. Events the CPU or the kernel does not support are left out, and
+/// on other systems nothing is counted.
+
+namespace PerfCounters {
+  enum Event { Cycles, Instructions, L1DMisses, LLCMisses, DTLBMisses, BranchMisses, EVENT_NB };
+
+  struct Sample {
+    uint64_t count[EVENT_NB] = {};
+    bool available[EVENT_NB] = {};
+
+    Sample& operator+=(const Sample& s);
+    Sample operator-(const Sample& s) const;
+  };
+
+  class Group {
+    int fd[EVENT_NB] = { -1, -1, -1, -1, -1, -1 };
+
+  public:
+    Group() = default;
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+    ~Group() { close(); }
+
+    void open();  // Counts the calling thread from now on
+    void close();
+    Sample read() const;
+  };
+
+  std::string error();                // Why no event could be opened, if so
+  std::string rates(const Sample& s); // IPC and misses per 1000 instructions
+}
+
 namespace CommandLine {
   void init(int argc, char* argv[]);
 
@@ -37,9 +37,14 @@ namespace Stockfish::Eval::NNUE {
   // Evaluation function
   AlignedPtr<Network> network[LayerStacks];
 
+  // The small network, for lopsided positions, allocated only once loaded
+  LargePagePtr<FeatureTransformerSmall> featureTransformerSmall;
+  AlignedPtr<NetworkSmall> networkSmall[LayerStacks];
+
   // Evaluation function file name
   std::string fileName;
   std::string netDescription;
+  std::string netDescriptionSmall;
 
   namespace Detail {
 
@@ -77,14 +82,48 @@ namespace Stockfish::Eval::NNUE {
     return reference.write_parameters(stream);
   }
 
-  }  // namespace Detail
+  // Read the feature transformer, which may have int8 weights
+  template <typename T>
+  bool read_transformer(std::istream& stream, T& reference, bool int8) {
+
+    std::uint32_t header = read_little_endian<std::uint32_t>(stream);
+    if (!stream || header != (int8 ? T::get_int8_hash_value() : T::get_hash_value())) return false;
+    return reference.read_parameters(stream, int8);
+  }
+
+  // Free the parameters. The int8 weights are allocated apart, and not freed
+  // by the deleter.
+  template <typename Transformer, typename Net>
+  void release(LargePagePtr<Transformer>& transformer, AlignedPtr<Net>* nets) {
+
+    if (transformer)
+      transformer->set_int8(false);
+
+    transformer.reset();
+    for (std::size_t i = 0; i < LayerStacks; ++i)
+      nets[i].reset();
+  }
 
   // Initialize the evaluation function parameters
-  void initialize() {
+  template <typename Transformer, typename Net>
+  void initialize(LargePagePtr<Transformer>& transformer, AlignedPtr<Net>* nets) {
 
-    Detail::initialize(featureTransformer);
+    release(transformer, nets);
+    initialize(transformer);
     for (std::size_t i = 0; i < LayerStacks; ++i)
-      Detail::initialize(network[i]);
+      initialize(nets[i]);
+  }
+
+  }  // namespace Detail
+
+  // Use the int8 weights of the feature transformers or not
+  void set_int8(bool enable) {
+
+    if (featureTransformer)
+      featureTransformer->set_int8(enable);
+
+    if (featureTransformerSmall)
+      featureTransformerSmall->set_int8(enable);
   }
 
   // Read network header
@@ -111,30 +150,41 @@ namespace Stockfish::Eval::NNUE {
     return !stream.fail();
   }
 
-  // Read network parameters
-  bool read_parameters(std::istream& stream) {
+  // Read network parameters, of the main or of the small network
+  template <typename Transformer, typename Net>
+  bool read_parameters(std::istream& stream, Transformer& transformer, AlignedPtr<Net>* nets, std::string* desc) {
+
+    constexpr std::uint32_t Hash = Transformer::get_hash_value() ^ Net::get_hash_value();
+    constexpr std::uint32_t Int8Hash = Transformer::get_int8_hash_value() ^ Net::get_hash_value();
 
     std::uint32_t hashValue;
-    if (!read_header(stream, &hashValue, &netDescription)) return false;
-    if (hashValue != HashValue) return false;
-    if (!Detail::read_parameters(stream, *featureTransformer)) return false;
+    if (!read_header(stream, &hashValue, desc)) return false;
+    if (hashValue != Hash && hashValue != Int8Hash) return false;
+    if (!Detail::read_transformer(stream, transformer, hashValue == Int8Hash)) return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
-      if (!Detail::read_parameters(stream, *(network[i]))) return false;
+      if (!Detail::read_parameters(stream, *(nets[i]))) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
   // Write network parameters
   bool write_parameters(std::ostream& stream) {
 
-    if (!write_header(stream, HashValue, netDescription)) return false;
-    if (!Detail::write_parameters(stream, *featureTransformer)) return false;
+    const bool int8 = featureTransformer->int8();
+
+    if (!write_header(stream, int8 ? FeatureTransformer::get_int8_hash_value() ^ Network::get_hash_value()
+                                   : HashValue, netDescription)) return false;
+    write_little_endian<std::uint32_t>(stream, int8 ? FeatureTransformer::get_int8_hash_value()
+                                                    : FeatureTransformer::get_hash_value());
+    if (!featureTransformer->write_parameters(stream)) return false;
     for (std::size_t i = 0; i < LayerStacks; ++i)
       if (!Detail::write_parameters(stream, *(network[i]))) return false;
     return (bool)stream;
   }
 
   // Evaluation function. Perform differential calculation.
-  Value evaluate(const Position& pos, bool adjusted) {
+  template <typename Transformer, typename Net>
+  std::pair<Value, bool> evaluate(const Transformer& transformer, const AlignedPtr<Net>* nets,
+                                  const Position& pos, bool adjusted, bool allowLazy) {
 
     // We manually align the arrays on the stack because with gcc < 9.3
     // overaligning stack variables with alignas() doesn't work correctly.
@@ -143,28 +193,28 @@ namespace Stockfish::Eval::NNUE {
 
 #if defined(ALIGNAS_ON_STACK_VARIABLES_BROKEN)
     TransformedFeatureType transformedFeaturesUnaligned[
-      FeatureTransformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
-    char bufferUnaligned[Network::BufferSize + alignment];
+      Transformer::BufferSize + alignment / sizeof(TransformedFeatureType)];
+    char bufferUnaligned[Net::BufferSize + alignment];
 
     auto* transformedFeatures = align_ptr_up<alignment>(&transformedFeaturesUnaligned[0]);
     auto* buffer = align_ptr_up<alignment>(&bufferUnaligned[0]);
 #else
     alignas(alignment)
-      TransformedFeatureType transformedFeatures[FeatureTransformer::BufferSize];
-    alignas(alignment) char buffer[Network::BufferSize];
+      TransformedFeatureType transformedFeatures[Transformer::BufferSize];
+    alignas(alignment) char buffer[Net::BufferSize];
 #endif
 
     ASSERT_ALIGNED(transformedFeatures, alignment);
     ASSERT_ALIGNED(buffer, alignment);
 
     const std::size_t bucket = (pos.count<ALL_PIECES>() - 1) / 4;
-    const auto [psqt, lazy] = featureTransformer->transform(pos, transformedFeatures, bucket);
+    const auto [psqt, lazy] = transformer.transform(pos, transformedFeatures, bucket, allowLazy);
 
     if (lazy)
-      return static_cast<Value>(psqt / OutputScale);
+      return { static_cast<Value>(psqt / OutputScale), true };
     else
     {
-      const auto output = network[bucket]->propagate(transformedFeatures, buffer);
+      const auto output = nets[bucket]->propagate(transformedFeatures, buffer);
 
       int materialist = psqt;
       int positional  = output[0];
@@ -177,16 +227,71 @@ namespace Stockfish::Eval::NNUE {
 
       int sum = (A * materialist + B * positional) / 128;
 
-      return static_cast<Value>( sum / OutputScale );
+      return { static_cast<Value>( sum / OutputScale ), false };
     }
   }
 
+  // Evaluation with the main network. For a position too lopsided for more
+  // than the PSQT part, only that part is returned and '*lazy' is set.
+  Value evaluate(const Position& pos, bool adjusted, bool* lazy) {
+
+    const auto [v, isLazy] = evaluate(*featureTransformer, network, pos, adjusted, true);
+
+    if (lazy)
+      *lazy = isLazy;
+
+    return v;
+  }
+
+  // Evaluation with the small network, which must be loaded
+  Value evaluate_small(const Position& pos, bool adjusted) {
+
+    return evaluate(*featureTransformerSmall, networkSmall, pos, adjusted, false).first;
+  }
+
   // Load eval, from a file stream or a memory stream
   bool load_eval(std::string name, std::istream& stream) {
 
-    initialize();
+    Detail::initialize(featureTransformer, network);
     fileName = name;
-    return read_parameters(stream);
+    return read_parameters(stream, *featureTransformer, network, &netDescription);
+  }
+
+  // Load the small network, which is freed again if it fails
+  bool load_eval_small(std::istream& stream) {
+
+    Detail::initialize(featureTransformerSmall, networkSmall);
+
+    if (read_parameters(stream, *featureTransformerSmall, networkSmall, &netDescriptionSmall))
+      return true;
+
+    unload_small();
+    return false;
+  }
+
+  // Free the small network
+  void unload_small() {
+
+    Detail::release(featureTransformerSmall, networkSmall);
+  }
+
+  // Whether the small network is loaded
+  bool has_small() {
+
+    return bool(featureTransformerSmall);
+  }
+
+  // Bytes allocated for the network parameters
+  size_t memory() {
+
+    size_t bytes = featureTransformer ? sizeof(FeatureTransformer) + featureTransformer->int8_memory()
+                                      + LayerStacks * sizeof(Network) : 0;
+
+    if (featureTransformerSmall)
+      bytes +=  sizeof(FeatureTransformerSmall) + featureTransformerSmall->int8_memory()
+              + LayerStacks * sizeof(NetworkSmall);
+
+    return bytes;
   }
 
   // Save eval, to a file stream or a memory stream
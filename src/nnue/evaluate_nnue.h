@@ -54,6 +54,14 @@ namespace Stockfish::Eval::NNUE {
   template <typename T>
   using LargePagePtr = std::unique_ptr<T, LargePageDeleter<T>>;
 
+  // Input feature converter and the evaluation networks, one per bucket
+  extern LargePagePtr<FeatureTransformer> featureTransformer;
+  extern AlignedPtr<Network> network[LayerStacks];
+
+  // The same for the small network, null unless it is loaded
+  extern LargePagePtr<FeatureTransformerSmall> featureTransformerSmall;
+  extern AlignedPtr<NetworkSmall> networkSmall[LayerStacks];
+
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_EVALUATE_NNUE_H_INCLUDED
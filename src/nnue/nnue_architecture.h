@@ -34,24 +34,31 @@ namespace Stockfish::Eval::NNUE {
   // Input features used in evaluation function
   using FeatureSet = Features::HalfKAv2;
 
-  // Number of input feature dimensions after conversion
+  // Number of input feature dimensions after conversion, for the main network
+  // and for the small one used on lopsided positions
   constexpr IndexType TransformedFeatureDimensions = 512;
+  constexpr IndexType TransformedFeatureDimensionsSmall = 128;
   constexpr IndexType PSQTBuckets = 8;
   constexpr IndexType LayerStacks = 8;
 
   namespace Layers {
 
     // Define network structure
-    using InputLayer = InputSlice<TransformedFeatureDimensions * 2>;
-    using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 16>>;
-    using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-    using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+    template <IndexType TransformedDimensions>
+    struct Structure {
+      using InputLayer = InputSlice<TransformedDimensions * 2>;
+      using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 16>>;
+      using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
+      using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+    };
 
   }  // namespace Layers
 
-  using Network = Layers::OutputLayer;
+  using Network = Layers::Structure<TransformedFeatureDimensions>::OutputLayer;
+  using NetworkSmall = Layers::Structure<TransformedFeatureDimensionsSmall>::OutputLayer;
 
   static_assert(TransformedFeatureDimensions % MaxSimdWidth == 0, "");
+  static_assert(TransformedFeatureDimensionsSmall % MaxSimdWidth == 0, "");
   static_assert(Network::OutputDimensions == 1, "");
   static_assert(std::is_same<Network::OutputType, std::int32_t>::value, "");
 
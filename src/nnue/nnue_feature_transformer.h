@@ -25,8 +25,12 @@
 #include "nnue_architecture.h"
 
 #include "../misc.h"
+#include "../position.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring> // std::memset()
+#include <limits>
 
 namespace Stockfish::Eval::NNUE {
 
@@ -44,6 +48,9 @@ namespace Stockfish::Eval::NNUE {
   #define vec_store(a,b) _mm512_store_si512(a,b)
   #define vec_add_16(a,b) _mm512_add_epi16(a,b)
   #define vec_sub_16(a,b) _mm512_sub_epi16(a,b)
+  #define vec_mul_16(a,b) _mm512_mullo_epi16(a,b)
+  #define vec_set_16(a) _mm512_set1_epi16(a)
+  #define vec_load_8_16(a) _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(a)))
   #define vec_load_psqt(a) _mm256_load_si256(a)
   #define vec_store_psqt(a,b) _mm256_store_si256(a,b)
   #define vec_add_psqt_32(a,b) _mm256_add_epi32(a,b)
@@ -59,6 +66,9 @@ namespace Stockfish::Eval::NNUE {
   #define vec_store(a,b) _mm256_store_si256(a,b)
   #define vec_add_16(a,b) _mm256_add_epi16(a,b)
   #define vec_sub_16(a,b) _mm256_sub_epi16(a,b)
+  #define vec_mul_16(a,b) _mm256_mullo_epi16(a,b)
+  #define vec_set_16(a) _mm256_set1_epi16(a)
+  #define vec_load_8_16(a) _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(a)))
   #define vec_load_psqt(a) _mm256_load_si256(a)
   #define vec_store_psqt(a,b) _mm256_store_si256(a,b)
   #define vec_add_psqt_32(a,b) _mm256_add_epi32(a,b)
@@ -74,6 +84,14 @@ namespace Stockfish::Eval::NNUE {
   #define vec_store(a,b) *(a)=(b)
   #define vec_add_16(a,b) _mm_add_epi16(a,b)
   #define vec_sub_16(a,b) _mm_sub_epi16(a,b)
+  #define vec_mul_16(a,b) _mm_mullo_epi16(a,b)
+  #define vec_set_16(a) _mm_set1_epi16(a)
+  #ifdef USE_SSE41
+  #define vec_load_8_16(a) _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a)))
+  #else
+  #define vec_load_8_16(a) _mm_srai_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a)), \
+                                                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a))), 8)
+  #endif
   #define vec_load_psqt(a) (*(a))
   #define vec_store_psqt(a,b) *(a)=(b)
   #define vec_add_psqt_32(a,b) _mm_add_epi32(a,b)
@@ -89,6 +107,10 @@ namespace Stockfish::Eval::NNUE {
   #define vec_store(a,b) *(a)=(b)
   #define vec_add_16(a,b) _mm_add_pi16(a,b)
   #define vec_sub_16(a,b) _mm_sub_pi16(a,b)
+  #define vec_mul_16(a,b) _mm_mullo_pi16(a,b)
+  #define vec_set_16(a) _mm_set1_pi16(a)
+  #define vec_load_8_16(a) _mm_srai_pi16(_mm_unpacklo_pi8(_mm_cvtsi32_si64(*reinterpret_cast<const int*>(a)), \
+                                                         _mm_cvtsi32_si64(*reinterpret_cast<const int*>(a))), 8)
   #define vec_load_psqt(a) (*(a))
   #define vec_store_psqt(a,b) *(a)=(b)
   #define vec_add_psqt_32(a,b) _mm_add_pi32(a,b)
@@ -104,6 +126,9 @@ namespace Stockfish::Eval::NNUE {
   #define vec_store(a,b) *(a)=(b)
   #define vec_add_16(a,b) vaddq_s16(a,b)
   #define vec_sub_16(a,b) vsubq_s16(a,b)
+  #define vec_mul_16(a,b) vmulq_s16(a,b)
+  #define vec_set_16(a) vdupq_n_s16(a)
+  #define vec_load_8_16(a) vmovl_s8(vld1_s8(a))
   #define vec_load_psqt(a) (*(a))
   #define vec_store_psqt(a,b) *(a)=(b)
   #define vec_add_psqt_32(a,b) vaddq_s32(a,b)
@@ -117,17 +142,28 @@ namespace Stockfish::Eval::NNUE {
 
   #endif
 
-  // Input feature converter
-  class FeatureTransformer {
+  // Input feature converter, of the given width and updating the given
+  // accumulator of the StateInfo
+  template <IndexType TransformedDimensions, Accumulator<TransformedDimensions> StateInfo::*accPtr>
+  class BasicFeatureTransformer {
 
    private:
     // Number of output dimensions for one side
-    static constexpr IndexType HalfDimensions = TransformedFeatureDimensions;
+    static constexpr IndexType HalfDimensions = TransformedDimensions;
 
     static constexpr int LazyThreshold = 1400;
 
+    using BiasType = std::int16_t;
+    using WeightType = std::int16_t;
+    using Int8WeightType = std::int8_t;
+    using PSQTWeightType = std::int32_t;
+
+    static constexpr std::uint32_t Int8HashBits = 0x18000000u;
+
     #ifdef VECTOR
-    static constexpr IndexType TileHeight = NumRegs * sizeof(vec_t) / 2;
+    // A tile uses at most NumRegs registers, fewer for a narrow transformer
+    static constexpr IndexType TileRegs = std::min(NumRegs, IndexType(HalfDimensions * 2 / sizeof(vec_t)));
+    static constexpr IndexType TileHeight = TileRegs * sizeof(vec_t) / 2;
     static constexpr IndexType PsqtTileHeight = NumPsqtRegs * sizeof(psqt_vec_t) / 4;
     static_assert(HalfDimensions % TileHeight == 0, "TileHeight must divide HalfDimensions");
     static_assert(PSQTBuckets % PsqtTileHeight == 0, "PsqtTileHeight must divide PSQTBuckets");
@@ -150,41 +186,135 @@ namespace Stockfish::Eval::NNUE {
       return FeatureSet::HashValue ^ OutputDimensions;
     }
 
-    // Read network parameters
-    bool read_parameters(std::istream& stream) {
+    // Hash value of the variant with int8 weights and a scale per feature
+    static constexpr std::uint32_t get_int8_hash_value() {
+      return get_hash_value() ^ Int8HashBits;
+    }
+
+    // Read network parameters, with int8 weights if 'int8' is set
+    bool read_parameters(std::istream& stream, bool int8) {
       for (std::size_t i = 0; i < HalfDimensions; ++i)
         biases[i] = read_little_endian<BiasType>(stream);
-      for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
-        weights[i] = read_little_endian<WeightType>(stream);
+
+      if (int8)
+      {
+        alloc_int8();
+        for (std::size_t i = 0; i < InputDimensions; ++i)
+          scales[i] = read_little_endian<BiasType>(stream);
+        for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
+          weights8[i] = read_little_endian<Int8WeightType>(stream);
+
+        // The int16 weights are the scaled int8 ones, so that both give the same result
+        for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
+          weights[i] = WeightType(scales[i / HalfDimensions] * weights8[i]);
+      }
+      else
+        for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
+          weights[i] = read_little_endian<WeightType>(stream);
+
       for (std::size_t i = 0; i < PSQTBuckets * InputDimensions; ++i)
         psqtWeights[i] = read_little_endian<PSQTWeightType>(stream);
       return !stream.fail();
     }
 
-    // Write network parameters
+    // Write network parameters, with int8 weights if in use
     bool write_parameters(std::ostream& stream) const {
       for (std::size_t i = 0; i < HalfDimensions; ++i)
         write_little_endian<BiasType>(stream, biases[i]);
-      for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
-        write_little_endian<WeightType>(stream, weights[i]);
+
+      if (weights8)
+      {
+        for (std::size_t i = 0; i < InputDimensions; ++i)
+          write_little_endian<BiasType>(stream, scales[i]);
+        for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
+          write_little_endian<Int8WeightType>(stream, weights8[i]);
+      }
+      else
+        for (std::size_t i = 0; i < HalfDimensions * InputDimensions; ++i)
+          write_little_endian<WeightType>(stream, weights[i]);
+
+      for (std::size_t i = 0; i < PSQTBuckets * InputDimensions; ++i)
+        write_little_endian<PSQTWeightType>(stream, psqtWeights[i]);
       return !stream.fail();
     }
 
-    // Convert input features
-    std::pair<std::int32_t, bool> transform(const Position& pos, OutputType* output, int bucket) const {
+    // Switch the accumulator updates to int8 weights, half the memory traffic
+    // of the int16 ones. The weights of each feature are quantized with their
+    // own scale, the one with the smallest squared error, where the scales
+    // below the one which fits all of them in [-127, 127] clip the largest
+    // weights. Weights read from an int8 file are kept as they are.
+    void set_int8(bool enable) {
+      if (!enable)
+      {
+        aligned_large_pages_free(weights8);
+        weights8 = nullptr;
+        return;
+      }
+
+      if (weights8)
+        return;
+
+      alloc_int8();
+
+      // Round to nearest and clip, without letting the scaled weight overflow int16
+      auto quantize = [](int w, int scale) {
+        int q = (2 * w + (w < 0 ? -scale : scale)) / (2 * scale);
+        return std::clamp(q, -std::min(127, 32767 / scale), std::min(127, 32767 / scale));
+      };
+
+      for (std::size_t i = 0; i < InputDimensions; ++i)
+      {
+        const WeightType* w = &weights[HalfDimensions * i];
+        int maxWeight = 0;
+        for (IndexType j = 0; j < HalfDimensions; ++j)
+          maxWeight = std::max(maxWeight, std::abs(int(w[j])));
+
+        int bestScale = 1;
+        int64_t bestError = std::numeric_limits<int64_t>::max();
+
+        for (int scale = 1; scale <= std::max(1, (maxWeight + 126) / 127); ++scale)
+        {
+          int64_t error = 0;
+          for (IndexType j = 0; j < HalfDimensions; ++j)
+          {
+            int64_t e = w[j] - scale * quantize(w[j], scale);
+            error += e * e;
+          }
+
+          if (error < bestError)
+            bestError = error, bestScale = scale;
+        }
+
+        scales[i] = BiasType(bestScale);
+        for (IndexType j = 0; j < HalfDimensions; ++j)
+          weights8[HalfDimensions * i + j] = Int8WeightType(quantize(w[j], bestScale));
+      }
+    }
+
+    bool int8() const { return weights8 != nullptr; }
+
+    // Bytes allocated for the int8 weights, on top of the class itself
+    std::size_t int8_memory() const {
+      return weights8 ? HalfDimensions * InputDimensions * sizeof(Int8WeightType) : 0;
+    }
+
+    // Convert input features. With 'allowLazy', only the PSQT part is computed
+    // when it is large enough on its own.
+    std::pair<std::int32_t, bool> transform(const Position& pos, OutputType* output, int bucket,
+                                            bool allowLazy = true) const {
       update_accumulator(pos, WHITE);
       update_accumulator(pos, BLACK);
 
       const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
-      const auto& accumulation = pos.state()->accumulator.accumulation;
-      const auto& psqtAccumulation = pos.state()->accumulator.psqtAccumulation;
+      const auto& accumulation = (pos.state()->*accPtr).accumulation;
+      const auto& psqtAccumulation = (pos.state()->*accPtr).psqtAccumulation;
 
       const auto psqt = (
             psqtAccumulation[static_cast<int>(perspectives[0])][bucket]
           - psqtAccumulation[static_cast<int>(perspectives[1])][bucket]
         ) / 2;
 
-      if (abs(psqt) > LazyThreshold * OutputScale)
+      if (allowLazy && abs(psqt) > LazyThreshold * OutputScale)
         return { psqt, true };
 
   #if defined(USE_AVX512)
@@ -297,6 +427,46 @@ namespace Stockfish::Eval::NNUE {
     }
 
    private:
+    void alloc_int8() {
+      if (!weights8)
+        weights8 = static_cast<Int8WeightType*>(
+            aligned_large_pages_alloc(HalfDimensions * InputDimensions * sizeof(Int8WeightType)));
+
+      if (!weights8)
+      {
+        std::cerr << "Failed to allocate int8 weights for the feature transformer." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+
+  #ifdef VECTOR
+    // Register k of a tile of the weights of a feature, from the int8 weights
+    // widened and scaled, or from the int16 ones.
+    template<bool Int8>
+    vec_t weight_reg(IndexType offset, IndexType k, vec_t scale) const {
+      if constexpr (Int8)
+        return vec_mul_16(vec_load_8_16(&weights8[offset + k * sizeof(vec_t) / 2]), scale);
+      else
+        return reinterpret_cast<const vec_t*>(&weights[offset])[k];
+    }
+  #endif
+
+    template<bool Int8>
+    WeightType weight(IndexType index, IndexType offset) const {
+      if constexpr (Int8)
+        return WeightType(scales[index] * weights8[offset]);
+      else
+        return weights[offset];
+    }
+
+    void update_accumulator(const Position& pos, const Color perspective) const {
+      if (weights8)
+        update_accumulator<true>(pos, perspective);
+      else
+        update_accumulator<false>(pos, perspective);
+    }
+
+    template<bool Int8>
     void update_accumulator(const Position& pos, const Color perspective) const {
 
       // The size must be enough to contain the largest possible update.
@@ -308,7 +478,7 @@ namespace Stockfish::Eval::NNUE {
   #ifdef VECTOR
       // Gcc-10.2 unnecessarily spills AVX2 registers if this array
       // is defined in the VECTOR code below, once in each branch
-      vec_t acc[NumRegs];
+      vec_t acc[TileRegs];
       psqt_vec_t psqt[NumPsqtRegs];
   #endif
 
@@ -316,7 +486,7 @@ namespace Stockfish::Eval::NNUE {
       // of the estimated gain in terms of features to be added/subtracted.
       StateInfo *st = pos.state(), *next = nullptr;
       int gain = FeatureSet::refresh_cost(pos);
-      while (st->accumulator.state[perspective] == EMPTY)
+      while ((st->*accPtr).state[perspective] == EMPTY)
       {
         // This governs when a full feature refresh is needed and how many
         // updates are better than just one full refresh.
@@ -327,7 +497,7 @@ namespace Stockfish::Eval::NNUE {
         st = st->previous;
       }
 
-      if (st->accumulator.state[perspective] == COMPUTED)
+      if ((st->*accPtr).state[perspective] == COMPUTED)
       {
         if (next == nullptr)
           return;
@@ -345,8 +515,8 @@ namespace Stockfish::Eval::NNUE {
             ksq, st2, perspective, removed[1], added[1]);
 
         // Mark the accumulators as computed.
-        next->accumulator.state[perspective] = COMPUTED;
-        pos.state()->accumulator.state[perspective] = COMPUTED;
+        (next->*accPtr).state[perspective] = COMPUTED;
+        (pos.state()->*accPtr).state[perspective] = COMPUTED;
 
         // Now update the accumulators listed in states_to_update[], where the last element is a sentinel.
         StateInfo *states_to_update[3] =
@@ -356,8 +526,8 @@ namespace Stockfish::Eval::NNUE {
         {
           // Load accumulator
           auto accTile = reinterpret_cast<vec_t*>(
-            &st->accumulator.accumulation[perspective][j * TileHeight]);
-          for (IndexType k = 0; k < NumRegs; ++k)
+            &(st->*accPtr).accumulation[perspective][j * TileHeight]);
+          for (IndexType k = 0; k < TileRegs; ++k)
             acc[k] = vec_load(&accTile[k]);
 
           for (IndexType i = 0; states_to_update[i]; ++i)
@@ -366,24 +536,24 @@ namespace Stockfish::Eval::NNUE {
             for (const auto index : removed[i])
             {
               const IndexType offset = HalfDimensions * index + j * TileHeight;
-              auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
-              for (IndexType k = 0; k < NumRegs; ++k)
-                acc[k] = vec_sub_16(acc[k], column[k]);
+              const vec_t scale = Int8 ? vec_set_16(scales[index]) : vec_t{};
+              for (IndexType k = 0; k < TileRegs; ++k)
+                acc[k] = vec_sub_16(acc[k], weight_reg<Int8>(offset, k, scale));
             }
 
             // Difference calculation for the activated features
             for (const auto index : added[i])
             {
               const IndexType offset = HalfDimensions * index + j * TileHeight;
-              auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
-              for (IndexType k = 0; k < NumRegs; ++k)
-                acc[k] = vec_add_16(acc[k], column[k]);
+              const vec_t scale = Int8 ? vec_set_16(scales[index]) : vec_t{};
+              for (IndexType k = 0; k < TileRegs; ++k)
+                acc[k] = vec_add_16(acc[k], weight_reg<Int8>(offset, k, scale));
             }
 
             // Store accumulator
             accTile = reinterpret_cast<vec_t*>(
-              &states_to_update[i]->accumulator.accumulation[perspective][j * TileHeight]);
-            for (IndexType k = 0; k < NumRegs; ++k)
+              &(states_to_update[i]->*accPtr).accumulation[perspective][j * TileHeight]);
+            for (IndexType k = 0; k < TileRegs; ++k)
               vec_store(&accTile[k], acc[k]);
           }
         }
@@ -392,7 +562,7 @@ namespace Stockfish::Eval::NNUE {
         {
           // Load accumulator
           auto accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-            &st->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+            &(st->*accPtr).psqtAccumulation[perspective][j * PsqtTileHeight]);
           for (std::size_t k = 0; k < NumPsqtRegs; ++k)
             psqt[k] = vec_load_psqt(&accTilePsqt[k]);
 
@@ -418,7 +588,7 @@ namespace Stockfish::Eval::NNUE {
 
             // Store accumulator
             accTilePsqt = reinterpret_cast<psqt_vec_t*>(
-              &states_to_update[i]->accumulator.psqtAccumulation[perspective][j * PsqtTileHeight]);
+              &(states_to_update[i]->*accPtr).psqtAccumulation[perspective][j * PsqtTileHeight]);
             for (std::size_t k = 0; k < NumPsqtRegs; ++k)
               vec_store_psqt(&accTilePsqt[k], psqt[k]);
           }
@@ -427,12 +597,12 @@ namespace Stockfish::Eval::NNUE {
   #else
         for (IndexType i = 0; states_to_update[i]; ++i)
         {
-          std::memcpy(states_to_update[i]->accumulator.accumulation[perspective],
-              st->accumulator.accumulation[perspective],
+          std::memcpy((states_to_update[i]->*accPtr).accumulation[perspective],
+              (st->*accPtr).accumulation[perspective],
               HalfDimensions * sizeof(BiasType));
 
           for (std::size_t k = 0; k < PSQTBuckets; ++k)
-            states_to_update[i]->accumulator.psqtAccumulation[perspective][k] = st->accumulator.psqtAccumulation[perspective][k];
+            (states_to_update[i]->*accPtr).psqtAccumulation[perspective][k] = (st->*accPtr).psqtAccumulation[perspective][k];
 
           st = states_to_update[i];
 
@@ -442,10 +612,10 @@ namespace Stockfish::Eval::NNUE {
             const IndexType offset = HalfDimensions * index;
 
             for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] -= weights[offset + j];
+              (st->*accPtr).accumulation[perspective][j] -= weight<Int8>(index, offset + j);
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
+              (st->*accPtr).psqtAccumulation[perspective][k] -= psqtWeights[index * PSQTBuckets + k];
           }
 
           // Difference calculation for the activated features
@@ -454,10 +624,10 @@ namespace Stockfish::Eval::NNUE {
             const IndexType offset = HalfDimensions * index;
 
             for (IndexType j = 0; j < HalfDimensions; ++j)
-              st->accumulator.accumulation[perspective][j] += weights[offset + j];
+              (st->*accPtr).accumulation[perspective][j] += weight<Int8>(index, offset + j);
 
             for (std::size_t k = 0; k < PSQTBuckets; ++k)
-              st->accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
+              (st->*accPtr).psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
           }
         }
   #endif
@@ -465,7 +635,7 @@ namespace Stockfish::Eval::NNUE {
       else
       {
         // Refresh the accumulator
-        auto& accumulator = pos.state()->accumulator;
+        auto& accumulator = pos.state()->*accPtr;
         accumulator.state[perspective] = COMPUTED;
         IndexList active;
         FeatureSet::append_active_indices(pos, perspective, active);
@@ -475,21 +645,21 @@ namespace Stockfish::Eval::NNUE {
         {
           auto biasesTile = reinterpret_cast<const vec_t*>(
               &biases[j * TileHeight]);
-          for (IndexType k = 0; k < NumRegs; ++k)
+          for (IndexType k = 0; k < TileRegs; ++k)
             acc[k] = biasesTile[k];
 
           for (const auto index : active)
           {
             const IndexType offset = HalfDimensions * index + j * TileHeight;
-            auto column = reinterpret_cast<const vec_t*>(&weights[offset]);
+            const vec_t scale = Int8 ? vec_set_16(scales[index]) : vec_t{};
 
-            for (unsigned k = 0; k < NumRegs; ++k)
-              acc[k] = vec_add_16(acc[k], column[k]);
+            for (unsigned k = 0; k < TileRegs; ++k)
+              acc[k] = vec_add_16(acc[k], weight_reg<Int8>(offset, k, scale));
           }
 
           auto accTile = reinterpret_cast<vec_t*>(
               &accumulator.accumulation[perspective][j * TileHeight]);
-          for (unsigned k = 0; k < NumRegs; k++)
+          for (unsigned k = 0; k < TileRegs; k++)
             vec_store(&accTile[k], acc[k]);
         }
 
@@ -525,7 +695,7 @@ namespace Stockfish::Eval::NNUE {
           const IndexType offset = HalfDimensions * index;
 
           for (IndexType j = 0; j < HalfDimensions; ++j)
-            accumulator.accumulation[perspective][j] += weights[offset + j];
+            accumulator.accumulation[perspective][j] += weight<Int8>(index, offset + j);
 
           for (std::size_t k = 0; k < PSQTBuckets; ++k)
             accumulator.psqtAccumulation[perspective][k] += psqtWeights[index * PSQTBuckets + k];
@@ -538,15 +708,18 @@ namespace Stockfish::Eval::NNUE {
   #endif
     }
 
-    using BiasType = std::int16_t;
-    using WeightType = std::int16_t;
-    using PSQTWeightType = std::int32_t;
-
     alignas(CacheLineSize) BiasType biases[HalfDimensions];
     alignas(CacheLineSize) WeightType weights[HalfDimensions * InputDimensions];
     alignas(CacheLineSize) PSQTWeightType psqtWeights[InputDimensions * PSQTBuckets];
+
+    // With int8 weights, the scale of the weights of each feature
+    alignas(CacheLineSize) BiasType scales[InputDimensions];
+    Int8WeightType* weights8; // Allocated apart, nullptr with int16 weights
   };
 
+  using FeatureTransformer = BasicFeatureTransformer<TransformedFeatureDimensions, &StateInfo::accumulator>;
+  using FeatureTransformerSmall = BasicFeatureTransformer<TransformedFeatureDimensionsSmall, &StateInfo::accumulatorSmall>;
+
 }  // namespace Stockfish::Eval::NNUE
 
 #endif // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
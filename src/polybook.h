@@ -39,6 +39,7 @@ public:
 
     void init(const std::string& bookfile);
     Stockfish::Move probe(Stockfish::Position& pos, bool bestBookMove);
+    size_t memory() const { return polyhash ? size_t(keycount) * 16 : 0; }
 
 private:
 
@@ -1076,6 +1076,8 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
   set_state(st);
   st->accumulator.state[WHITE] = Eval::NNUE::INIT;
   st->accumulator.state[BLACK] = Eval::NNUE::INIT;
+  st->accumulatorSmall.state[WHITE] = Eval::NNUE::INIT;
+  st->accumulatorSmall.state[BLACK] = Eval::NNUE::INIT;
 
   assert(pos_is_ok());
 
@@ -1464,7 +1466,9 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   assert(is_ok(m));
   assert(&newSt != st);
 
-  thisThread->nodes.fetch_add(1, std::memory_order_relaxed);
+  if (((thisThread->nodes.fetch_add(1, std::memory_order_relaxed) + 1) & (Thread::NodesBatch - 1)) == 0)
+      Threads.nodesBatched.fetch_add(Thread::NodesBatch, std::memory_order_relaxed);
+
   Key k = st->key ^ Zobrist::side;
 
   // Copy some fields of the old state to our new StateInfo object except the
@@ -1483,6 +1487,8 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   // Used by NNUE
   st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
   st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorSmall.state[WHITE] = Eval::NNUE::EMPTY;
+  st->accumulatorSmall.state[BLACK] = Eval::NNUE::EMPTY;
   auto& dp = st->dirtyPiece;
   dp.dirty_num = 1;
 
@@ -1635,6 +1641,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
       st->rule50 = 0;
   }
 
+  // Prefetch access to pawnsTable if a pawn moved or was captured
+  if (st->pawnKey != st->previous->pawnKey)
+      prefetch(thisThread->pawnsTable[st->pawnKey]);
+
   // Set capture piece
   st->capturedPiece = captured;
 
@@ -1784,6 +1794,8 @@ void Position::do_null_move(StateInfo& newSt) {
   st->dirtyPiece.piece[0] = NO_PIECE; // Avoid checks in UpdateAccumulator()
   st->accumulator.state[WHITE] = Eval::NNUE::EMPTY;
   st->accumulator.state[BLACK] = Eval::NNUE::EMPTY;
+  st->accumulatorSmall.state[WHITE] = Eval::NNUE::EMPTY;
+  st->accumulatorSmall.state[BLACK] = Eval::NNUE::EMPTY;
 
   if (st->epSquare != SQ_NONE)
   {
@@ -59,7 +59,8 @@ struct StateInfo {
   int        repetition;
 
   // Used by NNUE
-  Eval::NNUE::Accumulator accumulator;
+  Eval::NNUE::Accumulator<Eval::NNUE::TransformedFeatureDimensions> accumulator;
+  Eval::NNUE::Accumulator<Eval::NNUE::TransformedFeatureDimensionsSmall> accumulatorSmall;
   DirtyPiece dirtyPiece;
 };
 
@@ -23,8 +23,10 @@
 #include <iostream>
 #include <sstream>
 
+#include "cluster.h"
 #include "polybook.h"
 #include "evaluate.h"
+#include "memory.h"
 #include "misc.h"
 #include "movegen.h"
 #include "movepick.h"
@@ -88,6 +90,11 @@ namespace {
     return d > 14 ? 73 : 6 * d * d + 229 * d - 215;
   }
 
+  // Experience preload: positions walked from the root at most, and plies walked
+  // (0 = probe experience at every node instead)
+  constexpr size_t ExperiencePreloadMaxPositions = 1 << 16;
+  int ExperiencePreloadPlies;
+
   // Add a small random component to draw evaluations to avoid 3-fold blindness
   Value value_draw(Thread* thisThread) {
     return VALUE_DRAW + Value(2 * (thisThread->nodes & 1) - 1);
@@ -115,6 +122,7 @@ namespace {
   void update_pv(Move* pv, Move move, Move* childPv);
   void update_continuation_histories(Stack* ss, Piece pc, Square to, int bonus);
   void update_quiet_stats(const Position& pos, Stack* ss, Move move, int bonus, int depth);
+  void preload_experience(Position& pos, int plies, Move prevMove, size_t& positions);
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
@@ -165,6 +173,7 @@ void Search::clear() {
   Threads.main()->wait_for_search_finished();
 
   Time.availableNodes = 0;
+  Memory::apply(); // Books or experience may have changed what is left for the hash
   TT.clear();
   Threads.clear();
   Tablebases::init(Options["SyzygyPath"]); // Free mapped files
@@ -186,8 +195,12 @@ void MainThread::search() {
       return;
   }
 
+  Time.search_started();
+  Cluster::start_search();
+
   //Make sure experience has finished loading
   Experience::wait_for_loading_finished();
+  ExperiencePreloadPlies = Experience::enabled() ? int(Options["Experience Preload Plies"]) : 0;
 
   Color us = rootPos.side_to_move();
   Time.init(Limits, us, rootPos.game_ply());
@@ -230,7 +243,7 @@ void MainThread::search() {
                       if(q.first > 0 && !q.second)
                           quality.emplace_back(temp, q.first);
 
-                      temp = temp->next;
+                      temp = temp->next();
                   }
 
                   //Sort experience moves based on quality
@@ -292,11 +305,21 @@ void MainThread::search() {
 
       if (bookMove != MOVE_NONE && std::find(rootMoves.begin(), rootMoves.end(), bookMove) != rootMoves.end())
       {
-          for (Thread* th : Threads)
-              std::swap(th->rootMoves[0], *std::find(th->rootMoves.begin(), th->rootMoves.end(), bookMove));
+          ++bookHits;
+          std::swap(rootMoves[0], *std::find(rootMoves.begin(), rootMoves.end(), bookMove));
       }
       else
       {
+          //A book move we cannot play (e.g. not among 'searchmoves') is searched like any other position
+          bookMove = MOVE_NONE;
+
+          //Install experience in the TT and histories once, rather than probing it at every node
+          if (ExperiencePreloadPlies)
+          {
+              size_t positions = 0;
+              preload_experience(rootPos, ExperiencePreloadPlies, MOVE_NONE, positions);
+          }
+
           Threads.start_searching(); // start non-main threads
           Thread::search();          // main thread start searching
       }
@@ -314,9 +337,13 @@ void MainThread::search() {
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
   Threads.stop = true;
+  Time.search_finished();
+  lastSearchTime = Time.elapsed();
+  ++searches;
 
-  // Wait until all threads have finished
+  // Wait until all threads have finished, and for the workers of a cluster
   Threads.wait_for_search_finished();
+  std::vector<ThreadPool::Vote> clusterVotes = Cluster::finish_search();
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
@@ -324,22 +351,47 @@ void MainThread::search() {
       Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
 
   Thread* bestThread = this;
+  const ThreadPool::Vote* remoteBest = nullptr;
 
+  // The helpers have not searched, nor set up their root, if we played a book move
   if (   int(Options["MultiPV"]) == 1
+      && bookMove == MOVE_NONE
       && !Limits.depth
       && !(Skill(Options["Skill Level"]).enabled() || int(Options["UCI_LimitStrength"]))
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+  {
+      if (clusterVotes.empty())
+          bestThread = Threads.get_best_thread();
+      else
+      {
+          // The threads of the workers vote after ours
+          std::vector<ThreadPool::Vote> votes = Threads.votes();
+          size_t local = votes.size();
+          votes.insert(votes.end(), clusterVotes.begin(), clusterVotes.end());
+
+          size_t best = ThreadPool::best_vote(votes);
+          if (best < local)
+              bestThread = Threads.main_group()[best];
+          else
+              remoteBest = &clusterVotes[best - local];
+      }
+  }
+
+  // The move we play, with its score and depth, comes from the best vote of a
+  // worker when one wins, and from our best thread otherwise.
+  Move  bestMove  = remoteBest ? remoteBest->move  : bestThread->rootMoves[0].pv[0];
+  Value bestScore = remoteBest ? remoteBest->score : bestThread->rootMoves[0].score;
+  Depth bestDepth = remoteBest ? remoteBest->depth : bestThread->completedDepth;
 
   if (    bookMove == MOVE_NONE
       && !Experience::is_learning_paused()
-      && !bestThread->rootPos.is_chess960()
+      && !rootPos.is_chess960()
       && !(bool)Options["Experience Readonly"]
 	  && !(bool)Options["UCI_LimitStrength"]
-	  &&  bestThread->completedDepth >= EXP_MIN_DEPTH)
+	  &&  bestDepth >= EXP_MIN_DEPTH)
   {
       //Add best move
-      Experience::add_pv_experience(bestThread->rootPos.key(), bestThread->rootMoves[0].pv[0], bestThread->rootMoves[0].score, bestThread->completedDepth);
+      Experience::add_pv_experience(rootPos.key(), bestMove, bestScore, bestDepth);
 
       //Add moves from other threads
       struct UniqueMoveInfo
@@ -351,10 +403,10 @@ void MainThread::search() {
       };
 
       std::map<Move, UniqueMoveInfo> uniqueMoves;
-      for (Thread* th : Threads)
+      for (Thread* th : Threads.main_group())
       {
           //Skip 'bestMove' becasue it was already added it
-          if (th->rootMoves[0].pv[0] == bestThread->rootMoves[0].pv[0])
+          if (th->rootMoves[0].pv[0] == bestMove)
               continue;
 
           UniqueMoveInfo thisMove{ th->rootMoves[0].pv[0], th->completedDepth, th->rootMoves[0].score, 1 };
@@ -388,25 +440,52 @@ void MainThread::search() {
       }
 
       //Save experience if game is decided
-      if (Utility::is_game_decided(rootPos, bestThread->rootMoves[0].score))
+      if (Utility::is_game_decided(rootPos, bestScore))
       {
           Experience::save();
           Experience::pause_learning();
       }
   }
 
-  bestPreviousScore = bestThread->rootMoves[0].score;
+  bestPreviousScore = bestScore;
+
+  Move ponderMove = MOVE_NONE;
+
+  if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
+      ponderMove = bestThread->rootMoves[0].pv[1];
 
   // Send again PV info if we have a new best thread
-  if (bestThread != this)
+  if (remoteBest)
+  {
+      ponderMove = remoteBest->ponder;
+
+      sync_cout << "info depth " << remoteBest->depth
+                << " score " << UCI::value(remoteBest->score)
+                << " pv " << UCI::move(bestMove, rootPos.is_chess960())
+                << (ponderMove ? " " + UCI::move(ponderMove, rootPos.is_chess960()) : "") << sync_endl;
+  }
+  else if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
-  sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
+  sync_cout << "bestmove " << UCI::move(bestMove, rootPos.is_chess960());
 
-  if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
-      std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
+  if (ponderMove)
+      std::cout << " ponder " << UCI::move(ponderMove, rootPos.is_chess960());
 
   std::cout << sync_endl;
+
+  if (bestMove)
+      Threads.remember_move(rootPos, bestMove);
+
+  Time.bestmove_sent();
+}
+
+
+/// Thread::tt_hit_rate() returns the running average of TT hits of the thread
+
+double Thread::tt_hit_rate() const {
+
+  return double(ttHitAverage) / (TtHitAverageWindow * TtHitAverageResolution);
 }
 
 
@@ -416,6 +495,11 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  firstNodeTime = now_us() - Threads.thinkStamp;
+
+  if (Threads.countEvents)
+      perfCounters.open();
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -429,6 +513,8 @@ void Thread::search() {
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
+  uint64_t iterStartNodes = 0, lastIterNodes = 0, prevIterNodes = 0;
+  bool npsTimeManagement = Options["NPS Time Management"] && !Limits.npmsec;
 
   std::memset(ss-7, 0, 10 * sizeof(Stack));
   for (int i = 7; i > 0; i--)
@@ -494,6 +580,7 @@ void Thread::search() {
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
          && !Threads.stop
+         && !redirect
          && !(Limits.depth && mainThread && rootDepth > Limits.depth))
   {
       // Age out PV variability metric
@@ -512,7 +599,7 @@ void Thread::search() {
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop && !redirect; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -560,7 +647,7 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (Threads.stop || redirect)
                   break;
 
               // When failing high/low give some update (without cluttering
@@ -603,9 +690,18 @@ void Thread::search() {
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
       }
 
-      if (!Threads.stop)
+      if (!Threads.stop && !redirect)
           completedDepth = rootDepth;
 
+      // Track the size of the last iterations for node rate based time management
+      if (mainThread && !Threads.stop)
+      {
+          uint64_t n = Threads.nodes_batched();
+          prevIterNodes = lastIterNodes;
+          lastIterNodes = n - iterStartNodes;
+          iterStartNodes = n;
+      }
+
       if (rootMoves[0].pv[0] != lastBestMove) {
          lastBestMove = rootMoves[0].pv[0];
          lastBestMoveDepth = rootDepth;
@@ -638,12 +734,13 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.32 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          std::vector<Thread*> group = Threads.main_group();
+          for (Thread* th : group)
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
-          double bestMoveInstability = 1 + 2 * totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + 2 * totBestMoveChanges / group.size();
 
           double totalTime = Time.optimum() * fallingEval * reduction * bestMoveInstability;
 
@@ -652,8 +749,15 @@ void Thread::search() {
           if (rootMoves.size() == 1)
               totalTime = std::min(500.0, totalTime);
 
-          // Stop the search if we have exceeded the totalTime
-          if (Time.elapsed() > totalTime)
+          // At the current node rate, how long would the next iteration take?
+          TimePoint nextIterationTime = npsTimeManagement ? Time.next_iteration_time(lastIterNodes, prevIterNodes) : 0;
+
+          // Stop the search if we have exceeded the totalTime, or if the next
+          // iteration is not expected to complete before the maximum time.
+          if (   Time.elapsed() > totalTime
+              || (   nextIterationTime
+                  && Time.elapsed() > totalTime / 2
+                  && Time.elapsed() + nextIterationTime > Time.maximum()))
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
@@ -800,8 +904,15 @@ namespace {
         ss->ttPv = PvNode || (ss->ttHit && tte->is_pv());
     formerPv = ss->ttPv && !PvNode;
 
-    //Probe experience data
-    const Experience::ExpEntryEx *expEx = excludedMove == MOVE_NONE && Experience::enabled() ? Experience::probe(pos.key()) : nullptr;
+    //Probe experience data, unless it has been preloaded in the TT
+    const Experience::ExpEntryEx *expEx = nullptr;
+    if (excludedMove == MOVE_NONE && Experience::enabled() && !ExperiencePreloadPlies)
+    {
+        expEx = Experience::probe(pos.key());
+        thisThread->expProbes.store(thisThread->expProbes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (expEx)
+            thisThread->expHits.store(thisThread->expHits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
     const Experience::ExpEntryEx* tempExp = expEx;
     const Experience::ExpEntryEx* bestExp = nullptr;
 
@@ -856,7 +967,7 @@ namespace {
             }
         }
 
-        tempExp = tempExp->next;
+        tempExp = tempExp->next();
     }
 
     if (   ss->ttPv
@@ -1326,7 +1437,11 @@ moves_loop: // When in check, search starts from here
       newDepth += extension;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      Key childKey = pos.key_after(move);
+      prefetch(TT.first_entry(childKey));
+
+      if (Experience::enabled())
+          Experience::prefetch(childKey);
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
@@ -1449,7 +1564,8 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (   Threads.stop.load(std::memory_order_relaxed)
+          || thisThread->redirect.load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1558,11 +1674,19 @@ moves_loop: // When in check, search starts from here
 
     // Write gathered information in transposition table
     if (!excludedMove && !(rootNode && thisThread->pvIdx))
-        tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv,
-                  bestValue >= beta ? BOUND_LOWER :
-                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
+    {
+        Bound b = bestValue >= beta ? BOUND_LOWER :
+                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER;
+
+        tte->save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv, b,
                   depth, bestMove, ss->staticEval);
 
+        // Deep entries are also sent to the other processes of a cluster
+        if (Cluster::shares(depth))
+            Cluster::save(posKey, value_to_tt(bestValue, ss->ply), ss->ttPv, b,
+                          depth, bestMove, ss->staticEval);
+    }
+
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
     return bestValue;
@@ -1949,6 +2073,75 @@ moves_loop: // When in check, search starts from here
         thisThread->lowPlyHistory[ss->ply][from_to(move)] << stat_bonus(depth - 7);
   }
 
+  // preload_experience() walks the experience moves reachable from 'pos' up to
+  // 'plies' plies deep. The deepest entry of each position is saved to the TT as
+  // a PV entry, so that search() finds it like the per-node probe would have
+  // left it. The main history and the countermoves of all the (idle) threads are
+  // seeded with the best quiet move of each position, worse ones are penalized.
+
+  void preload_experience(Position& pos, int plies, Move prevMove, size_t& positions) {
+
+    const Experience::ExpEntryEx* expEx = Experience::probe(pos.key());
+    if (!expEx || positions >= ExperiencePreloadMaxPositions)
+        return;
+
+    positions++;
+
+    // Merging may have changed the order of the links, so look for the entries
+    // we need: the deepest one for the TT and the best one for the histories.
+    const Experience::ExpEntryEx* deepestExp = expEx;
+    const Experience::ExpEntryEx* bestExp = expEx;
+    for (const Experience::ExpEntryEx* tempExp = expEx->next(); tempExp; tempExp = tempExp->next())
+    {
+        if (tempExp->depth > deepestExp->depth)
+            deepestExp = tempExp;
+
+        if (tempExp->compare(bestExp) > 0)
+            bestExp = tempExp;
+    }
+
+    // The per-node probe saves the first entry deeper than the TT and, having no
+    // beta here, we take the deepest one, which wins there at any node depth. Its
+    // value is the score of a completed PV search of that depth, so it is saved as
+    // exact. The per-node probe does the same unless the entry fails high, and a
+    // lower bound then gives the same cutoff at that node.
+    bool ttHit;
+    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    if (   (!ttHit || deepestExp->depth > tte->depth())
+        && is_ok(deepestExp->move) && pos.pseudo_legal(deepestExp->move) && pos.legal(deepestExp->move))
+        tte->save(pos.key(), deepestExp->value, true, BOUND_EXACT, deepestExp->depth, deepestExp->move, VALUE_NONE);
+
+    Color us = pos.side_to_move();
+    for (const Experience::ExpEntryEx* tempExp = expEx; tempExp; tempExp = tempExp->next())
+    {
+        Move m = tempExp->move;
+        if (!is_ok(m) || !pos.pseudo_legal(m) || !pos.legal(m))
+            continue;
+
+        if (!pos.capture_or_promotion(m))
+        {
+            int bonus =  tempExp == bestExp                ?  stat_bonus(tempExp->depth)
+                       : tempExp->compare(bestExp) < 0 ? -stat_bonus(tempExp->depth) : 0;
+
+            for (Thread* th : Threads)
+            {
+                th->mainHistory[us][from_to(m)] << bonus;
+
+                if (tempExp == bestExp && is_ok(prevMove))
+                    th->counterMoves[pos.piece_on(to_sq(prevMove))][to_sq(prevMove)] = m;
+            }
+        }
+
+        if (plies > 1)
+        {
+            StateInfo st;
+            pos.do_move(m, st);
+            preload_experience(pos, plies - 1, m, positions);
+            pos.undo_move(m);
+        }
+    }
+  }
+
   // When playing with strength handicap, choose best move among a set of RootMoves
   // using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
 
@@ -2007,13 +2200,18 @@ void MainThread::check_time() {
       dbg_print();
   }
 
+  if (!Limits.npmsec)
+      Time.update_nps(elapsed, Threads.nodes_batched());
+
   // We should not stop pondering until told so by the GUI
   if (ponder)
       return;
 
   if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
       || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
+      || (   Limits.nodes
+          && Threads.nodes_batched() + Threads.size() * NodesBatch >= (uint64_t)Limits.nodes
+          && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
       Threads.stop = true;
 }
 
@@ -2129,6 +2327,8 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
 
     if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
     {
+        int64_t elapsed = now_us();
+
         // Rank moves using DTZ tables
         RootInTB = root_probe(pos, rootMoves);
 
@@ -2138,6 +2338,11 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
             dtz_available = false;
             RootInTB = root_probe_wdl(pos, rootMoves);
         }
+
+        sync_cout << "info string Syzygy root ranking of " << rootMoves.size() << " moves"
+                  << (RootInTB ? dtz_available ? " (DTZ)" : " (WDL)" : " failed")
+                  << " took " << now_us() - elapsed << " us on "
+                  << std::min(Threads.size(), rootMoves.size()) << " threads" << sync_endl;
     }
 
     if (RootInTB)
@@ -2158,4 +2363,23 @@ void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
     }
 }
 
+
+/// Tablebases::rank_candidate_moves() ranks the moves of a root other than the
+/// one being searched, e.g. a ponder candidate. Unlike rank_root_moves() it does
+/// not touch the probing settings of the search and prints nothing.
+
+void Tablebases::rank_candidate_moves(Position& pos, Search::RootMoves& rootMoves) {
+
+    int cardinality = std::min(int(Options["SyzygyProbeLimit"]), MaxCardinality);
+
+    if (   cardinality >= popcount(pos.pieces())
+        && !pos.can_castle(ANY_CASTLING)
+        && (root_probe(pos, rootMoves) || root_probe_wdl(pos, rootMoves)))
+        std::stable_sort(rootMoves.begin(), rootMoves.end(),
+                  [](const RootMove &a, const RootMove &b) { return a.tbRank > b.tbRank; } );
+    else
+        for (auto& m : rootMoves)
+            m.tbRank = 0;
+}
+
 } // namespace Stockfish
@@ -27,17 +27,21 @@
 #include <sstream>
 #include <type_traits>
 #include <mutex>
+#include <set>
+#include <thread>
 
 #include "../bitboard.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../uci.h"
 
 #include "tbprobe.h"
 
 #ifndef _WIN32
+#include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -71,6 +75,8 @@ inline Square operator^(Square s, int i) { return Square(int(s) ^ i); }
 
 const std::string PieceToChar = " PNBRQK  pnbrqk";
 
+uint32_t Generation; // Incremented at each init(), invalidates the block caches
+
 int MapPawns[SQUARE_NB];
 int MapB1H1H7[SQUARE_NB];
 int MapA1D1D4[SQUARE_NB];
@@ -166,6 +172,9 @@ static_assert(sizeof(LR) == 3, "LR tree entry must be 3 bytes");
 //  TBTable:  one object for each file with corresponding indexing information
 //  TBTables: has ownership of TBTable objects, keeping a list and a hash
 
+// Size of the currently mapped files, they are unmapped together at init time
+std::atomic<uint64_t> MappedBytes;
+
 // class TBFile memory maps/unmaps the single .rtbw and .rtbz files. Files are
 // memory mapped for best performance. Files are mapped at first access: at init
 // time only existence of the file is checked.
@@ -182,13 +191,14 @@ public:
     // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
     static std::string Paths;
 
-    TBFile(const std::string& f) {
-
 #ifndef _WIN32
-        constexpr char SepChar = ':';
+    static constexpr char SepChar = ':';
 #else
-        constexpr char SepChar = ';';
+    static constexpr char SepChar = ';';
 #endif
+
+    TBFile(const std::string& f) {
+
         std::stringstream ss(Paths);
         std::string path;
 
@@ -224,6 +234,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        uint64_t size = statbuf.st_size;
         *mapping = statbuf.st_size;
         *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
 #if defined(MADV_RANDOM)
@@ -246,6 +257,7 @@ public:
 
         DWORD size_high;
         DWORD size_low = GetFileSize(fd, &size_high);
+        uint64_t size = uint64_t(size_high) << 32 | size_low;
 
         if (size_low % 64 != 16)
         {
@@ -284,6 +296,8 @@ public:
             return *baseAddress = nullptr, nullptr;
         }
 
+        MappedBytes += size;
+
         return data + 4; // Skip Magics's header
     }
 
@@ -300,6 +314,127 @@ public:
 
 std::string TBFile::Paths;
 
+// Returns the names, without extension, of the .rtbw files in a directory
+std::vector<std::string> list_wdl_files(const std::string& dir) {
+
+    std::vector<std::string> names;
+    auto add = [&](const std::string& n) {
+        if (n.size() > 5 && n.compare(n.size() - 5, 5, ".rtbw") == 0)
+            names.push_back(n.substr(0, n.size() - 5));
+    };
+
+#ifndef _WIN32
+    if (DIR* d = opendir(dir.c_str()))
+    {
+        while (dirent* e = readdir(d))
+            add(e->d_name);
+
+        closedir(d);
+    }
+#else
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((dir + "\\*.rtbw").c_str(), &data);
+
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        do
+            add(data.cFileName);
+        while (FindNextFileA(h, &data));
+
+        FindClose(h);
+    }
+#endif
+
+    return names;
+}
+
+// Returns the last modification time of a directory, which changes when files
+// are added or removed, or 0 if it does not exist.
+int64_t dir_stamp(const std::string& dir) {
+
+#ifndef _WIN32
+    struct stat statbuf;
+    return stat(dir.c_str(), &statbuf) == 0 ? int64_t(statbuf.st_mtime) : 0;
+#else
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(dir.c_str(), GetFileExInfoStandard, &data))
+        return 0;
+
+    return int64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#endif
+}
+
+// Returns the names of the WDL files found in the Paths directories, with a
+// single scan of each directory. If a manifest file is given and it lists the
+// same directories, unchanged since it was written, the names are read from it
+// instead. Otherwise the manifest is rewritten after the scan.
+std::set<std::string> find_wdl_files(const std::string& manifest, bool& fromManifest) {
+
+    const std::string Header = "Syzygy manifest 1";
+
+    std::vector<std::pair<std::string, int64_t>> dirs;
+    std::stringstream ss(TBFile::Paths);
+    std::string path, line;
+
+    while (std::getline(ss, path, TBFile::SepChar))
+        dirs.emplace_back(path, dir_stamp(path));
+
+    std::set<std::string> names;
+    fromManifest = false;
+
+    if (!manifest.empty() && manifest != "<empty>")
+    {
+        std::ifstream in(manifest);
+        size_t matched = 0;
+        bool valid = std::getline(in, line) && line == Header;
+
+        while (valid && std::getline(in, line))
+        {
+            std::istringstream ls(line);
+            std::string tag;
+            int64_t stamp;
+            ls >> tag;
+
+            if (tag == "F")
+                ls >> path, names.insert(path);
+
+            else if (tag == "D" && ls >> stamp && std::getline(ls >> std::ws, path))
+            {
+                valid =    matched < dirs.size()
+                        && dirs[matched].first == path
+                        && dirs[matched].second == stamp
+                        && stamp;
+                ++matched;
+            }
+            else
+                valid = false;
+        }
+
+        if (valid && matched == dirs.size())
+            return fromManifest = true, names;
+
+        names.clear();
+    }
+
+    for (const auto& d : dirs)
+        for (const std::string& n : list_wdl_files(d.first))
+            names.insert(n);
+
+    if (!manifest.empty() && manifest != "<empty>")
+    {
+        std::ofstream out(manifest);
+        out << Header << "\n";
+
+        for (const auto& d : dirs)
+            out << "D " << d.second << " " << d.first << "\n";
+
+        for (const std::string& n : names)
+            out << "F " << n << "\n";
+    }
+
+    return names;
+}
+
 // struct PairsData contains low level indexing information to access TB data.
 // There are 8, 4 or 2 PairsData records for each TBTable, according to type of
 // table and if positions have pawns or not. It is populated at first access.
@@ -318,6 +453,7 @@ struct PairsData {
     size_t sparseIndexSize;        // Size of SparseIndex[] table
     uint8_t* data;                 // Start of Huffman compressed data
     std::vector<uint64_t> base64;  // base64[l - min_sym_len] is the 64bit-padded lowest symbol of length l
+    uint8_t lenStart[256];         // Shortest length (- min_sym_len) of a symbol starting with the given byte
     std::vector<uint8_t> symlen;   // Number of values (-1) represented by a given Huffman symbol: 1..256
     Piece pieces[TBPIECES];        // Position pieces: the order of pieces defines the groups
     uint64_t groupIdx[TBPIECES+1]; // Start index used for the encoding of the group's pieces
@@ -465,29 +601,27 @@ public:
         memset(hashTable, 0, sizeof(hashTable));
         wdlTable.clear();
         dtzTable.clear();
+        MappedBytes = 0;
     }
     size_t size() const { return wdlTable.size(); }
-    void add(const std::vector<PieceType>& pieces);
+    void add(const std::vector<PieceType>& pieces, const std::set<std::string>& files);
 };
 
 TBTables TBTables;
 
 // If the corresponding file exists two new objects TBTable<WDL> and TBTable<DTZ>
-// are created and added to the lists and hash table. Called at init time.
-void TBTables::add(const std::vector<PieceType>& pieces) {
+// are created and added to the lists and hash table. Called at init time with
+// the names of the WDL files found in the Paths directories.
+void TBTables::add(const std::vector<PieceType>& pieces, const std::set<std::string>& files) {
 
     std::string code;
 
     for (PieceType pt : pieces)
         code += PieceToChar[pt];
 
-    TBFile file(code.insert(code.find('K', 1), "v") + ".rtbw"); // KRK -> KRvK
-
-    if (!file.is_open()) // Only WDL file is checked
+    if (!files.count(code.insert(code.find('K', 1), "v"))) // KRK -> KRvK, only WDL file is checked
         return;
 
-    file.close();
-
     MaxCardinality = std::max((int)pieces.size(), MaxCardinality);
 
     wdlTable.emplace_back(code);
@@ -513,7 +647,104 @@ void TBTables::add(const std::vector<PieceType>& pieces) {
 // Huffman codes is the same for all blocks in the table. A non-symmetric pawnless TB file
 // will have one table for wtm and one for btm, a TB file with pawns will have tables per
 // file a,b,c,d also in this case one set for wtm and one for btm.
-int decompress_pairs(PairsData* d, uint64_t idx) {
+
+// read_sym() returns the canonical Huffman symbol at the beginning of buf64
+// and stores its length in bits in 'len'.
+inline Sym read_sym(const PairsData* d, uint64_t buf64, int& len) {
+
+    // Now get the symbol length. For any symbol s64 of length l right-padded
+    // to 64 bits we know that d->base64[l-1] >= s64 >= d->base64[l] so we
+    // can find the symbol length iterating through base64[], starting from
+    // the shortest length possible given the leading byte of buf64.
+    len = d->lenStart[buf64 >> 56]; // This is the symbol length - d->min_sym_len
+
+    while (buf64 < d->base64[len])
+        ++len;
+
+    // All the symbols of a given length are consecutive integers (numerical
+    // sequence property), so we can compute the offset of our symbol of
+    // length len, stored at the beginning of buf64.
+    Sym sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+
+    // Now add the value of the lowest symbol of length len to get our symbol
+    sym += number<Sym, LittleEndian>(&d->lowestSym[len]);
+
+    len += d->minSymLen; // Get the real length
+    return sym;
+}
+
+// decode_sym() reads the symbols of a block until reaching the one that
+// contains the value at the given offset, which is updated to be relative to
+// the beginning of the returned symbol.
+Sym decode_sym(const PairsData* d, uint32_t block, int& offset) {
+
+    // Find the start address of our block of canonical Huffman symbols
+    uint32_t* ptr = (uint32_t*)(d->data + ((uint64_t)block * d->sizeofBlock));
+
+    // Read the first 64 bits in our block, this is a (truncated) sequence of
+    // unknown number of symbols of unknown length but we know the first one
+    // is at the beginning of this 64 bits sequence.
+    uint64_t buf64 = number<uint64_t, BigEndian>(ptr); ptr += 2;
+    int buf64Size = 64, len;
+
+    while (true)
+    {
+        Sym sym = read_sym(d, buf64, len);
+
+        // If our offset is within the number of values represented by symbol sym
+        // we are done...
+        if (offset < d->symlen[sym] + 1)
+            return sym;
+
+        // ...otherwise update the offset and continue to iterate
+        offset -= d->symlen[sym] + 1;
+        buf64 <<= len;       // Consume the just processed symbol
+        buf64Size -= len;
+
+        if (buf64Size <= 32) { // Refill the buffer
+            buf64Size += 32;
+            buf64 |= (uint64_t)number<uint32_t, BigEndian>(ptr++) << (64 - buf64Size);
+        }
+    }
+}
+
+// decode_block() reads all the top level symbols of a block into a cache slot,
+// recording for each one the offset of the last value it represents.
+void decode_block(const PairsData* d, uint32_t block, BlockCache::Slot* slot) {
+
+    uint32_t* ptr = (uint32_t*)(d->data + ((uint64_t)block * d->sizeofBlock));
+    uint32_t* blockEnd = ptr + d->sizeofBlock / 4;
+    uint64_t buf64 = number<uint64_t, BigEndian>(ptr); ptr += 2;
+    int buf64Size = 64, len, end = -1;
+
+    slot->count = 0;
+
+    while (true)
+    {
+        Sym sym = read_sym(d, buf64, len);
+
+        end += d->symlen[sym] + 1;
+        slot->ends[slot->count] = uint16_t(end);
+        slot->syms[slot->count++] = sym;
+
+        if (end >= d->blockLength[block] || slot->count == BlockCache::SlotSyms)
+            break;
+
+        buf64 <<= len; // Consume the just processed symbol
+        buf64Size -= len;
+
+        // Refill the buffer, the last symbols of the block may be already
+        // fully loaded, so never read past the end of the block.
+        if (buf64Size <= 32 && ptr < blockEnd) {
+            buf64Size += 32;
+            buf64 |= (uint64_t)number<uint32_t, BigEndian>(ptr++) << (64 - buf64Size);
+        }
+    }
+
+    assert(end >= d->blockLength[block]);
+}
+
+int decompress_pairs(PairsData* d, uint64_t idx, BlockCache* cache) {
 
     // Special case where all table positions store the same value
     if (d->flags & TBFlag::SingleValue)
@@ -558,50 +789,25 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     while (offset > d->blockLength[block])
         offset -= d->blockLength[block++] + 1;
 
-    // Finally, we find the start address of our block of canonical Huffman symbols
-    uint32_t* ptr = (uint32_t*)(d->data + ((uint64_t)block * d->sizeofBlock));
-
-    // Read the first 64 bits in our block, this is a (truncated) sequence of
-    // unknown number of symbols of unknown length but we know the first one
-    // is at the beginning of this 64 bits sequence.
-    uint64_t buf64 = number<uint64_t, BigEndian>(ptr); ptr += 2;
-    int buf64Size = 64;
     Sym sym;
 
-    while (true)
+    // If the block is small enough to be cached, look for its symbols in the
+    // thread's cache, decoding the whole block on a miss.
+    bool found;
+    BlockCache::Slot* slot =  cache && d->sizeofBlock * 8 <= BlockCache::SlotSyms
+                            ? cache->probe(d, block, found) : nullptr;
+    if (slot)
     {
-        int len = 0; // This is the symbol length - d->min_sym_len
-
-        // Now get the symbol length. For any symbol s64 of length l right-padded
-        // to 64 bits we know that d->base64[l-1] >= s64 >= d->base64[l] so we
-        // can find the symbol length iterating through base64[].
-        while (buf64 < d->base64[len])
-            ++len;
-
-        // All the symbols of a given length are consecutive integers (numerical
-        // sequence property), so we can compute the offset of our symbol of
-        // length len, stored at the beginning of buf64.
-        sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
-
-        // Now add the value of the lowest symbol of length len to get our symbol
-        sym += number<Sym, LittleEndian>(&d->lowestSym[len]);
+        if (!found)
+            decode_block(d, block, slot);
 
-        // If our offset is within the number of values represented by symbol sym
-        // we are done...
-        if (offset < d->symlen[sym] + 1)
-            break;
-
-        // ...otherwise update the offset and continue to iterate
-        offset -= d->symlen[sym] + 1;
-        len += d->minSymLen; // Get the real length
-        buf64 <<= len;       // Consume the just processed symbol
-        buf64Size -= len;
-
-        if (buf64Size <= 32) { // Refill the buffer
-            buf64Size += 32;
-            buf64 |= (uint64_t)number<uint32_t, BigEndian>(ptr++) << (64 - buf64Size);
-        }
+        // Find the first symbol whose values reach our offset
+        int i = int(std::lower_bound(slot->ends, slot->ends + slot->count, uint16_t(offset)) - slot->ends);
+        offset -= i ? slot->ends[i - 1] + 1 : 0;
+        sym = slot->syms[i];
     }
+    else
+        sym = decode_sym(d, block, offset);
 
     // Ok, now we have our symbol that expands into d->symlen[sym] + 1 symbols.
     // We binary-search for our value recursively expanding into the left and
@@ -883,7 +1089,7 @@ encode_remaining:
     }
 
     // Now that we have the index, decompress the pair and get the score
-    return map_score(entry, tbFile, decompress_pairs(d, idx), wdl);
+    return map_score(entry, tbFile, decompress_pairs(d, idx, &pos.this_thread()->tbCache), wdl);
 }
 
 // Group together pieces that will be encoded together. The general rule is that
@@ -1019,6 +1225,20 @@ uint8_t* set_sizes(PairsData* d, uint8_t* data) {
     for (size_t i = 0; i < d->base64.size(); ++i)
         d->base64[i] <<= 64 - i - d->minSymLen; // Right-padding to 64 bits
 
+    // The length of a symbol is at least the one of the highest 64 bit value
+    // with the same leading byte, so lenStart[] lets the symbol length search
+    // start there instead of at the shortest length.
+    for (int b = 0; b < 256; ++b)
+    {
+        uint64_t highest = (uint64_t(b) << 56) | 0x00FFFFFFFFFFFFFFULL;
+        uint8_t len = 0;
+
+        while (highest < d->base64[len])
+            ++len;
+
+        d->lenStart[b] = len;
+    }
+
     data += d->base64.size() * sizeof(Sym);
     d->symlen.resize(number<uint16_t, LittleEndian>(data)); data += sizeof(uint16_t);
     d->btree = (LR*)data;
@@ -1261,11 +1481,65 @@ WDLScore search(Position& pos, ProbeState* result) {
 } // namespace
 
 
+/// BlockCache::resize() sets the size of the cache in MB, 0 disables it
+
+void Tablebases::BlockCache::resize(size_t mbSize) {
+
+    size_t count = (mbSize << 20) / sizeof(Slot) / Ways * Ways;
+
+    if (count != slots.size())
+        std::vector<Slot>(count).swap(slots);
+
+    hits = misses = 0;
+}
+
+
+/// BlockCache::probe() looks up the slot of the given block, setting 'found'
+/// if it is already decoded. Otherwise the least recently used slot of the set
+/// is assigned to the block and returned, and the caller must decode the block
+/// into it. Returns nullptr if the cache is disabled.
+
+Tablebases::BlockCache::Slot* Tablebases::BlockCache::probe(const void* table, uint32_t block, bool& found) {
+
+    if (slots.empty())
+        return nullptr;
+
+    uint64_t h =  uint64_t(uintptr_t(table)) * 0x9E3779B97F4A7C15ULL
+                ^ uint64_t(block) * 0xC2B2AE3D27D4EB4FULL;
+    Slot* set = &slots[mul_hi64(h ^ (h >> 29), slots.size() / Ways) * Ways];
+    Slot* victim = set;
+
+    for (Slot* s = set; s < set + Ways; ++s)
+    {
+        if (s->table == table && s->block == block && s->generation == Generation)
+        {
+            s->lastUse = ++clock;
+            found = true;
+            ++hits;
+            return s;
+        }
+
+        // Prefer slots left over from a previous init(), then the oldest one
+        if ((victim->generation == Generation) && (s->generation != Generation || s->lastUse < victim->lastUse))
+            victim = s;
+    }
+
+    victim->table = table;
+    victim->block = block;
+    victim->generation = Generation;
+    victim->lastUse = ++clock;
+    found = false;
+    ++misses;
+    return victim;
+}
+
+
 /// Tablebases::init() is called at startup and after every change to
 /// "SyzygyPath" UCI option to (re)create the various tables. It is not thread
 /// safe, nor it needs to be.
 void Tablebases::init(const std::string& paths) {
 
+    ++Generation; // Cached blocks refer to the tables we are about to free
     TBTables.clear();
     MaxCardinality = 0;
     TBFile::Paths = paths;
@@ -1367,45 +1641,56 @@ void Tablebases::init(const std::string& paths) {
             LeadPawnsSize[leadPawnsCnt][f] = idx;
         }
 
-    // Add entries in TB tables if the corresponding ".rtbw" file exists
+    // Add entries in TB tables if the corresponding ".rtbw" file exists. The
+    // directories are scanned once, instead of looking for every combination.
+    TimePoint elapsed = now();
+    bool fromManifest;
+    std::set<std::string> files = find_wdl_files(Options["SyzygyManifest"], fromManifest);
+
     for (PieceType p1 = PAWN; p1 < KING; ++p1) {
-        TBTables.add({KING, p1, KING});
+        TBTables.add({KING, p1, KING}, files);
 
         for (PieceType p2 = PAWN; p2 <= p1; ++p2) {
-            TBTables.add({KING, p1, p2, KING});
-            TBTables.add({KING, p1, KING, p2});
+            TBTables.add({KING, p1, p2, KING}, files);
+            TBTables.add({KING, p1, KING, p2}, files);
 
             for (PieceType p3 = PAWN; p3 < KING; ++p3)
-                TBTables.add({KING, p1, p2, KING, p3});
+                TBTables.add({KING, p1, p2, KING, p3}, files);
 
             for (PieceType p3 = PAWN; p3 <= p2; ++p3) {
-                TBTables.add({KING, p1, p2, p3, KING});
+                TBTables.add({KING, p1, p2, p3, KING}, files);
 
                 for (PieceType p4 = PAWN; p4 <= p3; ++p4) {
-                    TBTables.add({KING, p1, p2, p3, p4, KING});
+                    TBTables.add({KING, p1, p2, p3, p4, KING}, files);
 
                     for (PieceType p5 = PAWN; p5 <= p4; ++p5)
-                        TBTables.add({KING, p1, p2, p3, p4, p5, KING});
+                        TBTables.add({KING, p1, p2, p3, p4, p5, KING}, files);
 
                     for (PieceType p5 = PAWN; p5 < KING; ++p5)
-                        TBTables.add({KING, p1, p2, p3, p4, KING, p5});
+                        TBTables.add({KING, p1, p2, p3, p4, KING, p5}, files);
                 }
 
                 for (PieceType p4 = PAWN; p4 < KING; ++p4) {
-                    TBTables.add({KING, p1, p2, p3, KING, p4});
+                    TBTables.add({KING, p1, p2, p3, KING, p4}, files);
 
                     for (PieceType p5 = PAWN; p5 <= p4; ++p5)
-                        TBTables.add({KING, p1, p2, p3, KING, p4, p5});
+                        TBTables.add({KING, p1, p2, p3, KING, p4, p5}, files);
                 }
             }
 
             for (PieceType p3 = PAWN; p3 <= p1; ++p3)
                 for (PieceType p4 = PAWN; p4 <= (p1 == p3 ? p2 : p3); ++p4)
-                    TBTables.add({KING, p1, p2, KING, p3, p4});
+                    TBTables.add({KING, p1, p2, KING, p3, p4}, files);
         }
     }
 
-    sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
+    sync_cout << "info string Found " << TBTables.size() << " tablebases"
+              << (fromManifest ? " from manifest" : "") << " in " << now() - elapsed << " ms" << sync_endl;
+}
+
+// Returns the size of the tablebase files mapped so far
+size_t Tablebases::mapped_memory() {
+    return size_t(MappedBytes);
 }
 
 // Probe the WDL table for a particular position.
@@ -1511,52 +1796,108 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 }
 
 
+namespace {
+
+// Calls probe(pos, i, result) on the position after each root move i. The moves
+// are shared out among the search threads, which are idle before the search, in
+// the same way as TranspositionTable::clear(). Each helper sets up its own copy
+// of the root, bound to a search thread so that it uses that thread's block cache.
+// Returns false if any probe failed.
+template<typename F>
+bool probe_root_moves(Position& pos, const Search::RootMoves& rootMoves, F probe) {
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+
+    auto work = [&](Position& p) {
+        StateInfo st;
+        ProbeState result;
+
+        for (size_t i; !failed && (i = next++) < rootMoves.size(); )
+        {
+            p.do_move(rootMoves[i].pv[0], st);
+            probe(p, i, &result);
+            p.undo_move(rootMoves[i].pv[0]);
+
+            if (result == FAIL)
+                failed = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::string fen = pos.fen();
+    bool chess960 = pos.is_chess960();
+
+    for (size_t idx = 1; idx < std::min(Threads.size(), rootMoves.size()); ++idx)
+        threads.emplace_back([&, idx]() {
+            StateInfo st;
+            Position p;
+            p.set(fen, chess960, &st, Threads[idx]);
+            work(p);
+        });
+
+    work(pos);
+
+    for (std::thread& th : threads)
+        th.join();
+
+    return !failed;
+}
+
+} // namespace
+
+
 // Use the DTZ tables to rank root moves.
 //
 // A return value false indicates that not all probes were successful.
 bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves) {
 
-    ProbeState result;
-    StateInfo st;
-
     // Obtain 50-move counter for the root position
     int cnt50 = pos.rule50_count();
 
     // Check whether a position was repeated since the last zeroing move.
     bool rep = pos.has_repeated();
 
-    int dtz, bound = Options["Syzygy50MoveRule"] ? 900 : 1;
+    int bound = Options["Syzygy50MoveRule"] ? 900 : 1;
+    std::vector<int> dtzs(rootMoves.size());
 
-    // Probe and rank each move
-    for (auto& m : rootMoves)
-    {
-        pos.do_move(m.pv[0], st);
+    // Probe each move
+    bool ok = probe_root_moves(pos, rootMoves, [&](Position& p, size_t i, ProbeState* result) {
+
+        int dtz;
 
         // Calculate dtz for the current move counting from the root position
-        if (pos.rule50_count() == 0)
+        if (p.rule50_count() == 0)
         {
             // In case of a zeroing move, dtz is one of -101/-1/0/1/101
-            WDLScore wdl = -probe_wdl(pos, &result);
+            WDLScore wdl = -probe_wdl(p, result);
             dtz = dtz_before_zeroing(wdl);
         }
         else
         {
             // Otherwise, take dtz for the new position and correct by 1 ply
-            dtz = -probe_dtz(pos, &result);
+            dtz = -probe_dtz(p, result);
             dtz =  dtz > 0 ? dtz + 1
                  : dtz < 0 ? dtz - 1 : dtz;
         }
 
         // Make sure that a mating move is assigned a dtz value of 1
-        if (   pos.checkers()
+        if (   p.checkers()
             && dtz == 2
-            && MoveList<LEGAL>(pos).size() == 0)
+            && MoveList<LEGAL>(p).size() == 0)
             dtz = 1;
 
-        pos.undo_move(m.pv[0]);
+        dtzs[i] = dtz;
+    });
+
+    if (!ok)
+        return false;
 
-        if (result == FAIL)
-            return false;
+    // Rank each move
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        auto& m = rootMoves[i];
+        int dtz = dtzs[i];
 
         // Better moves are ranked higher. Certain wins are ranked equally.
         // Losing moves are ranked equally unless a 50-move draw is in sight.
@@ -1587,22 +1928,20 @@ bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves) {
 
     static const int WDL_to_rank[] = { -1000, -899, 0, 899, 1000 };
 
-    ProbeState result;
-    StateInfo st;
-
     bool rule50 = Options["Syzygy50MoveRule"];
+    std::vector<WDLScore> wdls(rootMoves.size());
 
-    // Probe and rank each move
-    for (auto& m : rootMoves)
-    {
-        pos.do_move(m.pv[0], st);
-
-        WDLScore wdl = -probe_wdl(pos, &result);
-
-        pos.undo_move(m.pv[0]);
+    // Probe each move
+    if (!probe_root_moves(pos, rootMoves, [&](Position& p, size_t i, ProbeState* result) {
+            wdls[i] = -probe_wdl(p, result);
+        }))
+        return false;
 
-        if (result == FAIL)
-            return false;
+    // Rank each move
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        auto& m = rootMoves[i];
+        WDLScore wdl = wdls[i];
 
         m.tbRank = WDL_to_rank[wdl + 2];
 
@@ -19,7 +19,9 @@
 #ifndef TBPROBE_H
 #define TBPROBE_H
 
+#include <cstdint>
 #include <ostream>
+#include <vector>
 
 #include "../search.h"
 
@@ -43,6 +45,39 @@ enum ProbeState {
     ZEROING_BEST_MOVE =  2  // Best move zeroes DTZ (capture or pawn move)
 };
 
+/// BlockCache is a per-thread cache of decoded blocks of compressed TB data.
+/// A slot keeps the top level Huffman symbols of one block together with the
+/// offset of the last value that each of them expands to, so that probing again
+/// into a cached block takes a binary search instead of decoding the block bit
+/// by bit. Slots are grouped in sets of Ways entries with LRU replacement.
+class BlockCache {
+public:
+  static constexpr int SlotSyms = 512; // Enough for blocks up to 64 bytes
+
+  struct Slot {
+    const void* table;
+    uint32_t block;
+    uint32_t generation;
+    uint32_t lastUse;
+    uint16_t count;
+    uint16_t ends[SlotSyms];
+    uint16_t syms[SlotSyms];
+  };
+
+  void resize(size_t mbSize);
+  size_t size_mb() const { return slots.size() * sizeof(Slot) >> 20; }
+  size_t memory() const { return slots.size() * sizeof(Slot); }
+  Slot* probe(const void* table, uint32_t block, bool& found);
+
+  uint64_t hits = 0, misses = 0;
+
+private:
+  static constexpr size_t Ways = 4;
+
+  std::vector<Slot> slots;
+  uint32_t clock = 0;
+};
+
 extern int MaxCardinality;
 
 void init(const std::string& paths);
@@ -51,6 +86,8 @@ int probe_dtz(Position& pos, ProbeState* result);
 bool root_probe(Position& pos, Search::RootMoves& rootMoves);
 bool root_probe_wdl(Position& pos, Search::RootMoves& rootMoves);
 void rank_root_moves(Position& pos, Search::RootMoves& rootMoves);
+void rank_candidate_moves(Position& pos, Search::RootMoves& rootMoves);
+size_t mapped_memory();
 
 inline std::ostream& operator<<(std::ostream& os, const WDLScore v) {
 
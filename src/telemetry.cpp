@@ -0,0 +1,221 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "memory.h"
+#include "telemetry.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+#include "uci.h"
+
+namespace Stockfish::Telemetry {
+
+namespace {
+
+  struct Metric {
+    std::string name;
+    const char* type;  // Prometheus type: "counter" or "gauge"
+    double value;
+    int thread;        // -1 for the engine wide metrics
+  };
+
+  const TimePoint StartTime = now();
+
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool exiting;
+
+  // Collects the metrics. The pool and the hash are locked against a resize.
+  // The counters are relaxed atomics, read while the search updates them.
+  std::vector<Metric> collect() {
+
+    std::vector<Metric> m;
+    std::lock_guard<std::mutex> lk1(Threads.resizeMutex);
+    std::lock_guard<std::mutex> lk2(TT.resizeMutex);
+
+    if (Threads.empty())
+        return m;
+
+    uint64_t expProbes = 0, expHits = 0;
+    uint64_t classicalCalls = 0, nnueCalls = 0, smallCalls = 0, both = 0, skipped = 0;
+
+    // Samples of a metric must be consecutive in the Prometheus format
+    for (Thread* th : Threads)
+        m.push_back({ "thread_nodes", "gauge", double(th->nodes.load(std::memory_order_relaxed)), int(th->id()) });
+
+    for (Thread* th : Threads)
+        m.push_back({ "thread_tb_hits", "gauge", double(th->tbHits.load(std::memory_order_relaxed)), int(th->id()) });
+
+    for (Thread* th : Threads)
+        m.push_back({ "thread_tt_hit_rate", "gauge", th->tt_hit_rate(), int(th->id()) });
+
+    for (Thread* th : Threads)
+    {
+        expProbes += th->expProbes.load(std::memory_order_relaxed);
+        expHits   += th->expHits.load(std::memory_order_relaxed);
+        classicalCalls += th->hybridStats.classicalCalls.load(std::memory_order_relaxed);
+        nnueCalls      += th->hybridStats.nnueCalls.load(std::memory_order_relaxed);
+        smallCalls     += th->hybridStats.smallCalls.load(std::memory_order_relaxed);
+        both           += th->hybridStats.both.load(std::memory_order_relaxed);
+        skipped        += th->hybridStats.skipped.load(std::memory_order_relaxed);
+    }
+
+    MainThread* main = Threads.main();
+
+    m.push_back({ "uptime_seconds", "gauge", (now() - StartTime) / 1000.0, -1 });
+    m.push_back({ "threads", "gauge", double(Threads.size()), -1 });
+    m.push_back({ "nodes", "gauge", double(Threads.nodes_searched()), -1 });
+    m.push_back({ "tb_hits", "gauge", double(Threads.tb_hits()), -1 });
+    m.push_back({ "hashfull_permille", "gauge", double(TT.hashfull()), -1 });
+    m.push_back({ "searches_total", "counter", double(main->searches), -1 });
+    m.push_back({ "book_hits_total", "counter", double(main->bookHits), -1 });
+    m.push_back({ "experience_probes_total", "counter", double(expProbes), -1 });
+    m.push_back({ "experience_hits_total", "counter", double(expHits), -1 });
+    // The evaluation counts restart at every 'ucinewgame', so they are gauges
+    m.push_back({ "eval_classical_calls", "gauge", double(classicalCalls), -1 });
+    m.push_back({ "eval_nnue_calls", "gauge", double(nnueCalls), -1 });
+    m.push_back({ "eval_nnue_small_calls", "gauge", double(smallCalls), -1 });
+    m.push_back({ "eval_both_calls", "gauge", double(both), -1 });
+    m.push_back({ "eval_classical_skipped", "gauge", double(skipped), -1 });
+    m.push_back({ "time_optimum_ms", "gauge", double(Time.optimum()), -1 });
+    m.push_back({ "time_maximum_ms", "gauge", double(Time.maximum()), -1 });
+    m.push_back({ "time_last_search_ms", "gauge", double(main->lastSearchTime), -1 });
+    m.push_back({ "time_nps_estimate", "gauge", Time.nps(), -1 });
+    m.push_back({ "resident_bytes", "gauge", double(Memory::resident()), -1 });
+
+    return m;
+  }
+
+  void write_loop(std::string file, Format f, int interval) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    while (!cv.wait_for(lk, std::chrono::milliseconds(interval), [] { return exiting; }))
+    {
+        std::string s = snapshot(f);
+
+        // Prometheus text files are replaced as a whole, so that a collector
+        // never reads a partial file. JSON lines are appended.
+        if (f == Prometheus)
+        {
+            std::ofstream(file + ".tmp") << s;
+            std::rename((file + ".tmp").c_str(), file.c_str());
+        }
+        else
+            std::ofstream(file, std::ios::app) << s;
+    }
+  }
+
+} // namespace
+
+
+/// snapshot() returns the current metrics in the given format
+
+std::string snapshot(Format f) {
+
+  std::vector<Metric> metrics = collect();
+  std::stringstream ss;
+
+  ss << std::setprecision(15); // Byte counts are printed in full
+
+  if (f == Prometheus)
+  {
+      std::string last;
+      for (const Metric& m : metrics)
+      {
+          if (m.name != last)
+              ss << "# TYPE sugar_" << m.name << " " << m.type << "\n";
+          last = m.name;
+
+          ss << "sugar_" << m.name;
+          if (m.thread >= 0)
+              ss << "{thread=\"" << m.thread << "\"}";
+          ss << " " << m.value << "\n";
+      }
+  }
+  else
+  {
+      ss << "{\"time\":" << std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::system_clock::now().time_since_epoch()).count();
+
+      for (const Metric& m : metrics)
+          if (m.thread < 0)
+              ss << ",\"" << m.name << "\":" << m.value;
+
+      std::map<int, std::stringstream> threads;
+      for (const Metric& m : metrics)
+          if (m.thread >= 0)
+              threads[m.thread] << ",\"" << m.name.substr(7) << "\":" << m.value; // Skip "thread_"
+
+      ss << ",\"threads_detail\":[";
+      for (auto& [id, s] : threads)
+          ss << (id ? "," : "") << "{\"id\":" << id << s.str() << "}";
+      ss << "]}\n";
+  }
+
+  return ss.str();
+}
+
+
+/// init() starts or restarts the writer thread according to the options,
+/// or stops it if 'Stats File' is empty.
+
+void init() {
+
+  stop();
+
+  std::string file = Options["Stats File"];
+  if (file.empty() || file == "<empty>")
+      return;
+
+  exiting = false;
+  writer = std::thread(write_loop, file,
+                       Options["Stats Format"] == "JSON" ? JSON : Prometheus,
+                       int(Options["Stats Interval"]));
+}
+
+
+/// stop() stops the writer thread, if running
+
+void stop() {
+
+  if (!writer.joinable())
+      return;
+
+  {
+      std::lock_guard<std::mutex> lk(mutex);
+      exiting = true;
+  }
+
+  cv.notify_one();
+  writer.join();
+}
+
+} // namespace Stockfish::Telemetry
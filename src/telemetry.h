@@ -0,0 +1,41 @@
+/*
+  SugaR, a UCI chess playing engine derived from Stockfish
+  Copyright (C) 2004-2021 The Stockfish developers (see AUTHORS file)
+
+  SugaR is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  SugaR is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <string>
+
+namespace Stockfish::Telemetry {
+
+/// Telemetry collects counters of the engine in a snapshot, as Prometheus text
+/// or as a JSON line. With 'Stats File' set, a background thread writes one to
+/// that file every 'Stats Interval' ms. Otherwise nothing runs and the snapshot
+/// is only taken by the 'stats' command. The counters themselves are per thread
+/// atomics, which their thread updates with relaxed loads and stores, so they
+/// cost next to nothing.
+
+enum Format { Prometheus, JSON };
+
+std::string snapshot(Format f);
+void init();
+void stop();
+
+} // namespace Stockfish::Telemetry
+
+#endif // #ifndef TELEMETRY_H_INCLUDED
@@ -19,11 +19,17 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "memory.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
+#include "timeman.h"
 #include "tt.h"
 
 namespace Stockfish {
@@ -61,6 +67,7 @@ void Thread::clear() {
   mainHistory.fill(0);
   lowPlyHistory.fill(0);
   captureHistory.fill(0);
+  hybridStats.clear();
 
   for (bool inCheck : { false, true })
       for (StatsType c : { NoCaptures, Captures })
@@ -78,11 +85,24 @@ void Thread::clear() {
 void Thread::start_searching() {
 
   std::lock_guard<std::mutex> lk(mutex);
+  setupOnly = false;
   searching = true;
   cv.notify_one(); // Wake up the thread in idle_loop()
 }
 
 
+/// Thread::start_setup() wakes up the thread only to set up its root position
+/// from the ThreadPool snapshot. The thread goes back to sleep when done.
+
+void Thread::start_setup() {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  setupOnly = true;
+  searching = true;
+  cv.notify_one();
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -93,10 +113,9 @@ void Thread::wait_for_search_finished() {
 }
 
 
-/// Thread::idle_loop() is where the thread is parked, blocked on the
-/// condition variable, when it has no work to do.
+/// Thread::bind() sets the affinity of the current thread, which must be this one
 
-void Thread::idle_loop() {
+void Thread::bind() {
 
   // If OS already scheduled us on a different group than 0 then don't overwrite
   // the choice, eventually we are one of many one-threaded processes running on
@@ -106,50 +125,145 @@ void Thread::idle_loop() {
   if (Options["Threads"] > 8)
       WinProcGroup::bindThisThread(idx);
 
+  CpuPlacement::bindThisThread(idx);
+}
+
+
+/// Thread::idle_loop() is where the thread is parked, blocked on the
+/// condition variable, when it has no work to do.
+
+void Thread::idle_loop() {
+
+  bind();
+
   while (true)
   {
+      {
+          std::lock_guard<std::mutex> lk(mutex);
+          searching = false;
+          cv.notify_one(); // Wake up anyone waiting for search finished
+      }
+
+      // With 'Spin Wait' set, poll for a while before blocking, so that a 'go'
+      // arriving soon after does not have to wait for the OS to wake us up.
+      for (int64_t end = now_us() + Threads.spinWait; !searching && now_us() < end; )
+          std::this_thread::yield();
+
       std::unique_lock<std::mutex> lk(mutex);
-      searching = false;
-      cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+      cv.wait(lk, [&]{ return bool(searching); });
 
       if (exit)
           return;
 
+      bool searchAfterSetup = !setupOnly;
       lk.unlock();
 
-      search();
+      if (bindPending)
+      {
+          bind();
+          bindPending = false;
+      }
+
+      if (rootPending)
+          Threads.setup_root(this);
+
+      if (searchAfterSetup)
+          search();
+
+      // After a ponderhit the threads of the other replies join the root
+      while (searchAfterSetup && redirect)
+      {
+          Threads.setup_root(this, true);
+          search();
+      }
   }
 }
 
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
-/// Upon resizing, threads are recreated to allow for binding if necessary.
+/// Only the difference is created or destroyed, so that the remaining threads
+/// keep their histories and caches warm across a resize.
 
 void ThreadPool::set(size_t requested) {
 
-  if (size() > 0)   // destroy any existing thread(s)
-  {
+  size_t previous = size();
+  int64_t start = now_us();
+
+  if (previous > 0)
       main()->wait_for_search_finished();
 
-      while (size() > 0)
-          delete back(), pop_back();
-  }
+  std::lock_guard<std::mutex> lk(resizeMutex);
+
+  while (size() > requested)
+      delete back(), pop_back();
 
   if (requested > 0)   // create new thread(s)
   {
-      push_back(new MainThread(0));
+      spinWait = int(Options["Spin Wait"]);
+
+      if (empty())
+          push_back(new MainThread(0));
 
       while (size() < requested)
           push_back(new Thread(size()));
-      clear();
 
-      // Reallocate the hash with the new threadpool size
-      TT.resize(size_t(Options["Hash"]));
+      for (Thread* th : *this)
+          th->tbCache.resize(size_t(Options["SyzygyBlockCache"]));
+
+      if (previous == 0)
+      {
+          clear();
+
+          // Allocate the hash with the new threadpool size
+          Memory::resize_hash();
+      }
+      else
+      {
+          for (size_t i = previous; i < size(); ++i)
+              at(i)->clear();
+
+          // Threads that existed before the pool grew past the binding
+          // threshold have not been bound to a processor group yet.
+          if (requested > 8 && previous <= 8)
+              rebind();
+      }
 
       // Init thread number dependent search params.
       Search::init();
+
+      // The threads are charged against the memory budget
+      if (previous > 0)
+          Memory::apply();
   }
+
+  if (previous > 0 && requested > 0 && previous != requested)
+  {
+      size_t delta = previous > requested ? previous - requested : requested - previous;
+      size_t bytes = delta * (sizeof(Thread) + (size_t(Options["SyzygyBlockCache"]) << 20));
+
+      sync_cout << "info string Threads resized from " << previous << " to " << requested
+                << " in " << now_us() - start << " us, "
+                << (requested > previous ? "allocated " : "freed ")
+                << (bytes >> 20) << " MB" << sync_endl;
+  }
+}
+
+
+/// ThreadPool::rebind() wakes up all the threads to set their affinity again,
+/// for instance after the placement policy has changed.
+
+void ThreadPool::rebind() {
+
+  if (empty())
+      return;
+
+  main()->wait_for_search_finished();
+
+  for (Thread* th : *this)
+      th->bindPending = true, th->start_setup();
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
 }
 
 
@@ -166,25 +280,30 @@ void ThreadPool::clear() {
 }
 
 
-/// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
-/// returns immediately. Main thread will wake up other threads and start the search.
+/// ThreadPool::start_thinking() takes a snapshot of the root, wakes up the main
+/// thread and returns immediately. Every thread sets up its own root from the
+/// snapshot when it starts, so that the helpers do it in parallel.
 
 void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
                                 const Search::LimitsType& limits, bool ponderMode) {
 
   main()->wait_for_search_finished();
 
+  thinkStamp = now_us();
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
+  nodesBatched = 0;
   main()->ponder = ponderMode;
   Search::Limits = limits;
-  Search::RootMoves rootMoves;
+  rootMoves.clear();
 
   for (const auto& m : MoveList<LEGAL>(pos))
       if (   limits.searchmoves.empty()
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
+  resolve_ponder(pos);
+
   if (!rootMoves.empty())
       Tablebases::rank_root_moves(pos, rootMoves);
 
@@ -195,52 +314,365 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (states.get())
       setupStates = std::move(states); // Ownership transfer, states is now empty
 
-  // We use Position::set() to set root position across threads. But there are
-  // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-  // be deduced from a fen string, so set() clears them and they are set from
-  // setupStates->back() later. The rootState is per thread, earlier states are shared
-  // since they are read-only.
+  rootFen = pos.fen();
+  rootChess960 = pos.is_chess960();
+
   for (Thread* th : *this)
   {
-      th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+      th->nodes = th->tbHits = 0;
       th->rootDepth = th->completedDepth = 0;
+      th->ponderGroup = 0;
+      th->redirect = false;
+      th->rootPending = true;
+  }
+
+  if (ponderMode && !rootMoves.empty())
+      setup_ponder_groups(pos);
+
+  // Only the main thread is woken here. It wakes the helpers once it knows
+  // that they have to search, and each of them then sets up its own root.
+  Time.wakeup_sent();
+  main()->start_searching();
+}
+
+
+/// ThreadPool::setup_root() is called by each thread after 'go' to set up its
+/// root from the snapshot. We use Position::set() to set the root position. But
+/// there are some StateInfo fields (previous, pliesFromNull, capturedPiece) that
+/// cannot be deduced from a fen string, so set() clears them and they are set
+/// from setupStates->back() later. The rootState is per thread, earlier states
+/// are shared since they are read-only.
+
+void ThreadPool::setup_root(Thread* th, bool redirected) {
+
+  if (redirected)
+  {
+      th->ponderGroup = 0;
+      th->redirect = false;
+  }
+
+  th->nmpMinPly = th->bestMoveChanges = 0;
+  th->rootDepth = th->completedDepth = 0;
+
+  if (size_t group = th->ponderGroup)
+  {
+      const PonderGroup& g = ponderGroups[group];
+      th->rootMoves = g.rootMoves;
+      th->rootPos.set(g.fen, rootChess960, &th->rootState, th);
+      th->rootState = *g.state;
+  }
+  else
+  {
       th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
+      th->rootPos.set(rootFen, rootChess960, &th->rootState, th);
       th->rootState = setupStates->back();
   }
 
-  main()->start_searching();
+  th->rootPending = false;
+  th->rootReadyTime = now_us() - thinkStamp;
+  th->firstNodeTime = -1;
+}
+
+
+/// ThreadPool::remember_move() is called with the best move at the end of a
+/// search. The position after it is the parent of the root of the next ponder.
+
+void ThreadPool::remember_move(const Position& pos, Move m) {
+
+  lastRootFen = pos.fen();
+  lastMove = m;
+}
+
+
+/// ThreadPool::setup_ponder_groups() splits the threads between the reply the
+/// GUI asked us to ponder on and the next most likely other replies, up to
+/// 'Ponder Candidates' in all. The probability of a reply comes from the TT
+/// score of the position after it, and the threads are shared in proportion,
+/// the main thread staying with the expected reply.
+
+void ThreadPool::setup_ponder_groups(Position& pos) {
+
+  constexpr double Temperature = double(PawnValueEg) / 2; // A pawn less is 7 times less likely
+
+  size_t candidates = size_t(Options["Ponder Candidates"]);
+  StateInfo* parentState = setupStates->back().previous;
+
+  ponderGroups.clear();
+  ponderStates.clear();
+
+  if (candidates < 2 || size() < 2 || !parentState || !lastMove)
+      return;
+
+  // The parent is set up after our last move, but keeps the history of the root
+  Position parent;
+  ponderStates.resize(2);
+  parent.set(lastRootFen, rootChess960, &ponderStates[0], main());
+  parent.do_move(lastMove, ponderStates[1]);
+
+  if (parent.key() != parentState->key)
+      return;
+
+  ponderStates[1] = *parentState;
+
+  // Score the replies from the point of view of the opponent
+  std::vector<PonderGroup> replies;
+  Value best = -VALUE_INFINITE;
+
+  for (const auto& m : MoveList<LEGAL>(parent))
+  {
+      bool found;
+      Key key = parent.key_after(m);
+      TTEntry* tte = TT.probe(key, found);
+      Value v = found && tte->value() != VALUE_NONE ? -tte->value() : -VALUE_INFINITE;
+
+      if (key == pos.key())
+          replies.insert(replies.begin(), { m, key, double(v), 0, "", nullptr, {} });
+      else if (v != -VALUE_INFINITE)
+          replies.push_back({ m, key, double(v), 0, "", nullptr, {} });
+
+      best = std::max(best, v);
+  }
+
+  if (replies.empty() || replies[0].key != pos.key())
+      return;
+
+  // The expected reply counts as the best one if the TT knows nothing about it
+  if (replies[0].probability == -VALUE_INFINITE)
+      replies[0].probability = best;
+
+  best = std::max(best, Value(replies[0].probability));
+
+  double sum = 0;
+  for (auto& r : replies)
+      sum += r.probability = std::exp((r.probability - best) / Temperature);
+
+  std::stable_sort(replies.begin() + 1, replies.end(), [](const PonderGroup& a, const PonderGroup& b) {
+      return a.probability > b.probability;
+  });
+
+  replies.resize(std::min(replies.size(), candidates));
+
+  // Give each reply its share of the threads, at least one, as long as the
+  // expected reply keeps its own share.
+  size_t rest = size() - std::max(size_t(1), size_t(size() * replies[0].probability / sum));
+
+  ponderGroups.push_back(replies[0]);
+
+  for (size_t i = 1; i < replies.size(); ++i)
+  {
+      PonderGroup& r = replies[i];
+      r.threads = std::max(size_t(1), size_t(size() * r.probability / sum));
+
+      if (r.threads > rest)
+          break;
+
+      ponderStates.emplace_back();
+      parent.do_move(r.reply, ponderStates.back());
+
+      for (const auto& m : MoveList<LEGAL>(parent))
+          r.rootMoves.emplace_back(m);
+
+      r.fen = parent.fen();
+      r.state = &ponderStates.back();
+
+      if (!r.rootMoves.empty())
+      {
+          Tablebases::rank_candidate_moves(parent, r.rootMoves);
+          rest -= r.threads;
+          ponderGroups.push_back(r);
+      }
+
+      parent.undo_move(r.reply);
+  }
+
+  if (ponderGroups.size() < 2)
+  {
+      ponderGroups.clear();
+      return;
+  }
+
+  // The last threads go to the other replies
+  ponderGroups[0].threads = size();
+  size_t idx = size();
+
+  for (size_t g = ponderGroups.size() - 1; g > 0; --g)
+      for (size_t i = 0; i < ponderGroups[g].threads; ++i)
+      {
+          (*this)[--idx]->ponderGroup = g;
+          --ponderGroups[0].threads;
+      }
+
+  ++ponderSearches;
+
+  std::stringstream ss;
+  ss << "info string Ponder on";
+  for (const PonderGroup& g : ponderGroups)
+      ss << " " << UCI::move(g.reply, rootChess960) << " (" << int(100 * g.probability / sum + 0.5)
+         << "%, " << g.threads << (g.threads > 1 ? " threads)" : " thread)");
+
+  sync_cout << ss.str() << sync_endl;
+}
+
+
+/// ThreadPool::ponderhit() is called when the GUI says that the expected reply
+/// was played. The threads of the other replies then move to the root.
+
+void ThreadPool::ponderhit() {
+
+  if (!ponderGroups.empty())
+  {
+      ponderHit = true;
+
+      for (Thread* th : *this)
+          if (th->ponderGroup)
+              th->redirect = true;
+  }
+
+  main()->ponder = false;
+}
+
+
+/// ThreadPool::resolve_ponder() is called by the 'go' that follows a search on
+/// several replies. If the opponent played one of the other replies, the root
+/// moves are ordered as the best thread of its group left them, and its
+/// searches are still in the TT. The hit rates are reported.
+
+void ThreadPool::resolve_ponder(const Position& pos) {
+
+  if (ponderGroups.empty())
+      return;
+
+  if (ponderHit || ponderGroups[0].key == pos.key())
+      ++ponderHits;
+  else
+      for (size_t g = 1; g < ponderGroups.size(); ++g)
+          if (ponderGroups[g].key == pos.key())
+          {
+              Thread* best = nullptr;
+              for (Thread* th : *this)
+                  if (   th->ponderGroup == g
+                      && (!best || th->completedDepth > best->completedDepth))
+                      best = th;
+
+              // Helpers that have not searched, after a book move, keep an old root
+              if (best && best->completedDepth)
+              {
+                  const Search::RootMoves& order = best->rootMoves;
+                  auto rank = [&](const Search::RootMove& rm) {
+                      return std::find(order.begin(), order.end(), rm.pv[0]) - order.begin();
+                  };
+
+                  std::stable_sort(rootMoves.begin(), rootMoves.end(), [&](const Search::RootMove& a, const Search::RootMove& b) {
+                      return rank(a) < rank(b);
+                  });
+              }
+
+              ++candidateHits;
+              break;
+          }
+
+  sync_cout << "info string Ponder hits " << ponderHits << "/" << ponderSearches
+            << ", other searched replies " << candidateHits << "/" << ponderSearches
+            << " (" << 100 * (ponderHits + candidateHits) / ponderSearches << "% useful)" << sync_endl;
+
+  ponderGroups.clear();
+  ponderHit = false;
+}
+
+
+/// ThreadPool::start_stats() reports for each thread how long after the last
+/// 'go' its root was set up and it reached its first node.
+
+std::string ThreadPool::start_stats() const {
+
+  std::stringstream ss;
+  int64_t maxReady = 0, maxFirst = 0;
+
+  ss << "Thread   root ready   first node (us after go)";
+  for (Thread* th : *this)
+  {
+      ss << "\n" << std::setw(6) << th->id()
+         << std::setw(13) << th->rootReadyTime
+         << std::setw(13) << (th->firstNodeTime < 0 ? "-" : std::to_string(th->firstNodeTime));
+      maxReady = std::max(maxReady, th->rootReadyTime);
+      maxFirst = std::max(maxFirst, th->firstNodeTime);
+  }
+  ss << "\n   max" << std::setw(13) << maxReady << std::setw(13) << maxFirst;
+
+  return ss.str();
 }
 
 Thread* ThreadPool::get_best_thread() const {
 
-    Thread* bestThread = front();
+    return main_group()[best_vote(votes())];
+}
+
+
+/// ThreadPool::main_group() returns the threads searching the root, which are
+/// all of them unless pondering on several replies.
+
+std::vector<Thread*> ThreadPool::main_group() const {
+
+    std::vector<Thread*> group;
+
+    for (Thread* th : *this)
+        if (!th->ponderGroup)
+            group.push_back(th);
+
+    return group;
+}
+
+
+/// ThreadPool::votes() returns the vote of each thread of the main group, in
+/// thread order.
+
+std::vector<ThreadPool::Vote> ThreadPool::votes() const {
+
+    std::vector<Vote> v;
+
+    for (Thread* th : main_group())
+    {
+        const Search::RootMove& rm = th->rootMoves[0];
+        v.push_back({ rm.pv[0], rm.pv.size() > 1 ? rm.pv[1] : MOVE_NONE, rm.score, th->completedDepth });
+    }
+
+    return v;
+}
+
+
+/// ThreadPool::best_vote() returns the index of the best of the given votes.
+/// The cluster mode passes the votes of the threads of all the processes.
+
+size_t ThreadPool::best_vote(const std::vector<Vote>& v) {
+
+    size_t best = 0;
     std::map<Move, int64_t> votes;
     Value minScore = VALUE_NONE;
 
     // Find minimum score of all threads
-    for (Thread* th: *this)
-        minScore = std::min(minScore, th->rootMoves[0].score);
+    for (const Vote& th : v)
+        minScore = std::min(minScore, th.score);
 
     // Vote according to score and depth, and select the best thread
-    for (Thread* th : *this)
+    for (size_t i = 0; i < v.size(); ++i)
     {
-        votes[th->rootMoves[0].pv[0]] +=
-            (th->rootMoves[0].score - minScore + 14) * int(th->completedDepth);
+        const Vote& th = v[i];
+
+        votes[th.move] += (th.score - minScore + 14) * int(th.depth);
 
-        if (abs(bestThread->rootMoves[0].score) >= VALUE_TB_WIN_IN_MAX_PLY)
+        if (abs(v[best].score) >= VALUE_TB_WIN_IN_MAX_PLY)
         {
             // Make sure we pick the shortest mate / TB conversion or stave off mate the longest
-            if (th->rootMoves[0].score > bestThread->rootMoves[0].score)
-                bestThread = th;
+            if (th.score > v[best].score)
+                best = i;
         }
-        else if (   th->rootMoves[0].score >= VALUE_TB_WIN_IN_MAX_PLY
-                 || (   th->rootMoves[0].score > VALUE_TB_LOSS_IN_MAX_PLY
-                     && votes[th->rootMoves[0].pv[0]] > votes[bestThread->rootMoves[0].pv[0]]))
-            bestThread = th;
+        else if (   th.score >= VALUE_TB_WIN_IN_MAX_PLY
+                 || (   th.score > VALUE_TB_LOSS_IN_MAX_PLY
+                     && votes[th.move] > votes[v[best].move]))
+            best = i;
     }
 
-    return bestThread;
+    return best;
 }
 
 
@@ -21,15 +21,19 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "evaluate.h"
 #include "material.h"
 #include "movepick.h"
 #include "pawns.h"
 #include "position.h"
 #include "search.h"
+#include "syzygy/tbprobe.h"
 #include "thread_win32_osx.h"
 
 namespace Stockfish {
@@ -44,9 +48,12 @@ class Thread {
   std::mutex mutex;
   std::condition_variable cv;
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  bool exit = false, setupOnly = false;
+  std::atomic_bool searching { true }; // Set before starting std::thread
   NativeThread stdThread;
 
+  void bind();
+
 public:
   explicit Thread(size_t);
   virtual ~Thread();
@@ -54,16 +61,32 @@ public:
   void clear();
   void idle_loop();
   void start_searching();
+  void start_setup();
   void wait_for_search_finished();
   size_t id() const { return idx; }
+  double tt_hit_rate() const;
+
+  // Searched nodes are also published to ThreadPool::nodesBatched once every
+  // NodesBatch nodes, so that the time check does not need to load the node
+  // counter of every thread.
+  static constexpr uint64_t NodesBatch = 1024;
 
   Pawns::Table pawnsTable;
   Material::Table materialTable;
+  Eval::HybridTable hybridTable;
+  Eval::HybridStats hybridStats;
+  Tablebases::BlockCache tbCache;
+  PerfCounters::Group perfCounters; // Opened by the thread itself when Threads.countEvents is set
   size_t pvIdx, pvLast;
-  uint64_t ttHitAverage;
+  uint64_t ttHitAverage = 0;
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  std::atomic<uint64_t> expProbes { 0 }, expHits { 0 }; // Since start, for the telemetry
+  bool rootPending = false, bindPending = false;
+  std::atomic<size_t> ponderGroup { 0 }; // Candidate reply searched while pondering, 0 for the root
+  std::atomic_bool redirect { false };   // Leave the candidate reply for the root after a ponderhit
+  int64_t rootReadyTime = 0, firstNodeTime = 0; // Microseconds since 'go', -1 if not searched
 
   Position rootPos;
   StateInfo rootState;
@@ -93,6 +116,8 @@ struct MainThread : public Thread {
   int callsCnt;
   bool stopOnPonderhit;
   std::atomic_bool ponder;
+  std::atomic<uint64_t> searches { 0 }, bookHits { 0 };
+  std::atomic<TimePoint> lastSearchTime { 0 };
 };
 
 
@@ -108,16 +133,61 @@ struct ThreadPool : public std::vector<Thread*> {
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
+  uint64_t nodes_batched()  const { return nodesBatched.load(std::memory_order_relaxed); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
   Thread* get_best_thread() const;
+
+  // A vote is the best root move of one thread, with its score and depth
+  struct Vote { Move move, ponder; Value score; Depth depth; };
+  std::vector<Vote> votes() const; // Of the main group
+  static size_t best_vote(const std::vector<Vote>& votes);
   void start_searching();
   void wait_for_search_finished() const;
-
+  void setup_root(Thread*, bool redirected = false);
+  void ponderhit();
+  void remember_move(const Position& pos, Move m);
+  std::vector<Thread*> main_group() const;
+  void rebind();
+  std::string start_stats() const;
+
+  std::mutex resizeMutex; // Held while threads are created or destroyed
   std::atomic_bool stop, increaseDepth;
+  std::atomic<uint64_t> nodesBatched; // Lags nodes_searched() by less than size() * NodesBatch
+  std::atomic<int> spinWait;          // Microseconds an idle thread polls before it blocks
+  int64_t thinkStamp;                 // now_us() when the last 'go' was received
+  bool countEvents = false;           // Search threads open their hardware counters
 
 private:
   StateListPtr setupStates;
 
+  // Root snapshot of the last 'go', from which every thread sets up its own root
+  std::string rootFen;
+  bool rootChess960;
+  Search::RootMoves rootMoves;
+
+  // With 'Ponder Candidates' the pondering threads are split in groups, one for
+  // each likely reply of the opponent. Group 0 searches the root, which is the
+  // position after the reply expected by the GUI.
+  struct PonderGroup {
+    Move reply;
+    Key key;
+    double probability;
+    size_t threads;
+    std::string fen;
+    StateInfo* state;
+    Search::RootMoves rootMoves;
+  };
+
+  void setup_ponder_groups(Position& pos);
+  void resolve_ponder(const Position& pos);
+
+  std::vector<PonderGroup> ponderGroups;
+  std::deque<StateInfo> ponderStates;
+  std::string lastRootFen;              // Root of our last search and its best move
+  Move lastMove = MOVE_NONE;
+  std::atomic_bool ponderHit { false };
+  uint64_t ponderSearches = 0, ponderHits = 0, candidateHits = 0;
+
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
     uint64_t sum = 0;
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <iostream>
 
 #include "search.h"
 #include "timeman.h"
@@ -28,6 +29,100 @@ namespace Stockfish {
 
 TimeManagement Time; // Our global time management object
 
+namespace {
+
+  // Number of samples needed before the measured latency is added to "Move Overhead"
+  constexpr size_t MinLatencySamples = 8;
+
+  // Percentile of the recent latencies used as overhead estimate
+  constexpr int LatencyPercentile = 95;
+
+  // Minimum interval between two node rate samples, and weight of a new sample
+  constexpr TimePoint NpsSampleInterval = 50;
+  constexpr double NpsSampleWeight = 0.25;
+
+} // namespace
+
+
+/// TimeManagement::LatencyWindow::percentile() returns the given percentile of
+/// the samples currently held in the window, or 0 if the window is empty.
+
+int64_t TimeManagement::LatencyWindow::percentile(int pct) const {
+
+  size_t n = size();
+  if (!n)
+      return 0;
+
+  int64_t sorted[Size];
+  std::copy(samples, samples + n, sorted);
+
+  size_t k = std::min(n - 1, n * pct / 100);
+  std::nth_element(sorted, sorted + k, sorted + n);
+  return sorted[k];
+}
+
+
+/// TimeManagement::search_started() is called by the main thread as soon as it
+/// wakes up for a new search. The delay between the wake up request and this
+/// point is the time the OS needed to schedule the main thread.
+
+void TimeManagement::search_started() {
+
+  startStamp = now_us();
+  searchGoStamp = goStamp.load(std::memory_order_relaxed); // Private copy, 'go' may arrive before bestmove_sent()
+
+  if (wakeStamp && startStamp >= wakeStamp)
+      schedSamples.push(startStamp - wakeStamp);
+}
+
+
+/// TimeManagement::bestmove_sent() is called after the bestmove has been flushed
+/// and records the latency not spent searching: from 'go' receipt to the start
+/// of the search, and from the end of the search to the bestmove output.
+
+void TimeManagement::bestmove_sent() {
+
+  int64_t flushStamp = now_us();
+
+  if (   searchGoStamp
+      && startStamp >= searchGoStamp
+      && flushStamp >= stopStamp)
+      lagSamples.push((startStamp - searchGoStamp) + (flushStamp - stopStamp));
+}
+
+
+/// TimeManagement::move_overhead() returns the move overhead to use for the
+/// current move. With "Auto Move Overhead" enabled, once enough samples are
+/// available, a high percentile of the measured latency plus the scheduling
+/// delay, with a 25% safety margin, is added to the "Move Overhead" option.
+/// The option still covers the GUI and the transport, which we cannot measure.
+
+TimePoint TimeManagement::move_overhead() {
+
+  TimePoint overhead = TimePoint(Options["Move Overhead"]);
+
+  if (!Options["Auto Move Overhead"])
+      return overhead;
+
+  int64_t lag   = lagSamples.percentile(LatencyPercentile);
+  int64_t sched = schedSamples.percentile(LatencyPercentile);
+  bool calibrated = lagSamples.size() >= MinLatencySamples;
+
+  if (calibrated)
+      overhead = std::min(overhead + TimePoint(((lag + sched) * 5 / 4 + 999) / 1000), TimePoint(5000));
+
+  if (overhead != lastOverhead)
+      sync_cout << "info string Move Overhead " << overhead << " ms"
+                << (calibrated ? " (auto)" : " (calibrating)")
+                << " latency p" << LatencyPercentile << " " << lag << " us"
+                << " scheduler p" << LatencyPercentile << " " << sched << " us"
+                << " samples " << lagSamples.size() << sync_endl;
+
+  lastOverhead = overhead;
+
+  return overhead;
+}
+
 
 /// TimeManagement::init() is called at the beginning of the search and calculates
 /// the bounds of time allowed for the current game ply. We currently support:
@@ -37,7 +132,7 @@ TimeManagement Time; // Our global time management object
 void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
 
   TimePoint minThinkingTime = TimePoint(Options["Minimum Thinking Time"]);
-  TimePoint moveOverhead    = TimePoint(Options["Move Overhead"]);
+  TimePoint moveOverhead    = move_overhead();
   TimePoint slowMover       = TimePoint(Options["Slow Mover"]);
   TimePoint npmsec          = TimePoint(Options["nodestime"]);
 
@@ -62,6 +157,10 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
 
   startTime = limits.startTime;
 
+  // Keep the node rate estimate of the previous moves as a prior for this one
+  npsSampleTime = 0;
+  npsSampleNodes = 0;
+
   // Maximum move horizon of 50 moves
   int mtg = limits.movestogo ? std::min(limits.movestogo, 50) : 50;
 
@@ -99,4 +198,36 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
       optimumTime += optimumTime / 4;
 }
 
+
+/// TimeManagement::update_nps() is called by the main thread from check_time()
+/// and keeps an exponential moving average of the node rate of the current
+/// search. It is fed by the batched node counter so it is cheap to call often.
+
+void TimeManagement::update_nps(TimePoint elapsedMs, uint64_t nodes) {
+
+  if (elapsedMs - npsSampleTime < NpsSampleInterval || nodes < npsSampleNodes)
+      return;
+
+  double sample = 1000.0 * (nodes - npsSampleNodes) / (elapsedMs - npsSampleTime);
+  npsEstimate = npsEstimate ? (1 - NpsSampleWeight) * npsEstimate + NpsSampleWeight * sample
+                            : sample;
+  npsSampleTime = elapsedMs;
+  npsSampleNodes = nodes;
+}
+
+
+/// TimeManagement::next_iteration_time() estimates the time needed to complete
+/// the next iteration at the current node rate, extrapolating its size from the
+/// effective branching factor of the last two iterations. Returns 0 when there
+/// is not enough data yet.
+
+TimePoint TimeManagement::next_iteration_time(uint64_t lastIterNodes, uint64_t prevIterNodes) const {
+
+  if (npsEstimate <= 0 || !lastIterNodes || !prevIterNodes)
+      return 0;
+
+  double ebf = std::clamp(double(lastIterNodes) / prevIterNodes, 1.5, 4.0);
+  return TimePoint(1000.0 * lastIterNodes * ebf / npsEstimate);
+}
+
 } // namespace Stockfish
@@ -19,6 +19,9 @@
 #ifndef TIMEMAN_H_INCLUDED
 #define TIMEMAN_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
@@ -33,15 +36,53 @@ public:
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
+  // In 'nodes as time' mode the exact node count is used, the batched one
+  // would let short controls overrun their node budget.
   TimePoint elapsed() const { return Search::Limits.npmsec ?
                                      TimePoint(Threads.nodes_searched()) : now() - startTime; }
 
+  // Node rate telemetry, sampled by the main thread from the batched node counter
+  void update_nps(TimePoint elapsedMs, uint64_t nodes);
+  TimePoint next_iteration_time(uint64_t lastIterNodes, uint64_t prevIterNodes) const;
+  double nps() const { return npsEstimate; }
+
+  // Latency measurement hooks used by the automatic move overhead
+  void go_received()     { goStamp.store(now_us(), std::memory_order_relaxed); }
+  void wakeup_sent()     { wakeStamp = now_us(); }
+  void search_started();
+  void search_finished() { stopStamp = now_us(); }
+  void bestmove_sent();
+
   int64_t availableNodes; // When in 'nodes as time' mode
 
 private:
+  TimePoint move_overhead();
+
+  /// LatencyWindow keeps the most recent latency samples (in microseconds)
+  /// in a ring buffer, so that a high percentile can be computed cheaply.
+  struct LatencyWindow {
+    static constexpr size_t Size = 64;
+
+    void push(int64_t v) { samples[count++ % Size] = v; }
+    size_t size() const { return std::min(count, Size); }
+    int64_t percentile(int pct) const;
+
+    int64_t samples[Size];
+    size_t count = 0;
+  };
+
   TimePoint startTime;
   TimePoint optimumTime;
   TimePoint maximumTime;
+
+  TimePoint npsSampleTime;
+  uint64_t npsSampleNodes;
+  double npsEstimate;
+
+  std::atomic<int64_t> goStamp { 0 }; // Written by the UI thread
+  int64_t wakeStamp, searchGoStamp, startStamp, stopStamp;
+  TimePoint lastOverhead = 0;
+  LatencyWindow lagSamples, schedSamples;
 };
 
 extern TimeManagement Time;
@@ -19,6 +19,8 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <mutex>
+
 #include "misc.h"
 #include "types.h"
 
@@ -86,6 +88,9 @@ public:
   TTEntry* probe(const Key key, bool& found) const;
   int hashfull() const;
   void resize(size_t mbSize);
+  size_t memory() const { return clusterCount * sizeof(Cluster); }
+
+  std::mutex resizeMutex; // Held while the table is reallocated
   void clear();
 
   TTEntry* first_entry(const Key key) const {
@@ -18,14 +18,20 @@
 
 #include <cassert>
 #include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "cluster.h"
 #include "evaluate.h"
+#include "memory.h"
 #include "movegen.h"
 #include "position.h"
 #include "search.h"
+#include "telemetry.h"
 #include "thread.h"
 #include "timeman.h"
 #include "tt.h"
@@ -68,6 +74,8 @@ namespace {
     else
         return;
 
+    Cluster::forward(is.str());
+
     states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
     pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
 
@@ -118,7 +126,10 @@ namespace {
         value += (value.empty() ? "" : " ") + token;
 
     if (Options.count(name))
+    {
         Options[name] = value;
+        Cluster::forward_option(name, value);
+    }
     else
         sync_cout << "No such option: " << name << sync_endl;
   }
@@ -135,6 +146,7 @@ namespace {
     bool ponderMode = false;
 
     limits.startTime = now(); // As early as possible!
+    Time.go_received();
 
     while (is >> token)
         if (token == "searchmoves") // Needs to be the last command on the line
@@ -162,7 +174,7 @@ namespace {
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
 
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  uint64_t bench(Position& pos, istream& args, StateListPtr& states) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
@@ -170,6 +182,19 @@ namespace {
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
+    // With 'Perf Counters' each search thread counts its hardware events, and
+    // the counts of every thread are read before and after each position.
+    Threads.countEvents = Options["Perf Counters"];
+    vector<PerfCounters::Sample> threadEvents;
+    PerfCounters::Sample totalEvents;
+
+    auto read_events = [&]() {
+        vector<PerfCounters::Sample> v;
+        for (Thread* th : Threads)
+            v.push_back(th->perfCounters.read());
+        return v;
+    };
+
     TimePoint elapsed = now();
 
     for (const auto& cmd : list)
@@ -182,9 +207,29 @@ namespace {
             cerr << "\nPosition: " << cnt++ << '/' << num << " (" << pos.fen() << ")" << endl;
             if (token == "go")
             {
+               vector<PerfCounters::Sample> before = read_events();
+
                go(pos, is, states);
                Threads.main()->wait_for_search_finished();
                nodes += Threads.nodes_searched();
+
+               if (Threads.countEvents)
+               {
+                   vector<PerfCounters::Sample> after = read_events();
+                   PerfCounters::Sample events;
+
+                   threadEvents.resize(after.size());
+                   for (size_t i = 0; i < after.size(); ++i)
+                   {
+                       PerfCounters::Sample d = after[i] - (i < before.size() ? before[i] : PerfCounters::Sample());
+                       threadEvents[i] += d;
+                       events += d;
+                   }
+
+                   totalEvents += events;
+                   if (events.available[PerfCounters::Instructions])
+                       cerr << "Counters: " << PerfCounters::rates(events) << endl;
+               }
             }
             else
                trace_eval(pos);
@@ -199,9 +244,263 @@ namespace {
     dbg_print(); // Just before exiting
 
     cerr << "\n==========================="
+         << "\n" << Eval::hybrid_stats()
+         << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    if (Threads.countEvents)
+    {
+        if (!totalEvents.available[PerfCounters::Instructions])
+            cerr << "Counters        : unavailable, " << PerfCounters::error() << endl;
+        else
+        {
+            cerr << "Counters        : " << PerfCounters::rates(totalEvents) << endl;
+
+            if (threadEvents.size() > 1)
+                for (size_t i = 0; i < threadEvents.size(); ++i)
+                    cerr << "  thread " << i << string(7 - to_string(i).size(), ' ') << ": "
+                         << PerfCounters::rates(threadEvents[i]) << endl;
+        }
+
+        for (Thread* th : Threads)
+            th->perfCounters.close();
+
+        Threads.countEvents = false;
+    }
+
+    return 1000 * nodes / elapsed;
+  }
+
+  // placebench() is called when engine receives the "placebench" command. It
+  // runs the bench at the given thread count and depth once for each value of
+  // the 'Thread Placement' option, and reports the speed of each.
+
+  void placebench(Position& pos, istream& args, StateListPtr& states) {
+
+    string threads = to_string(thread::hardware_concurrency()), depth = "13";
+    args >> threads >> depth;
+
+    string saved = Options["Thread Placement"];
+    vector<pair<string, uint64_t>> results;
+
+    for (string policy : { "None", "Cores", "Siblings" })
+    {
+        Options["Thread Placement"] = policy;
+        istringstream is("16 " + threads + " " + depth + " default depth");
+        results.emplace_back(policy, bench(pos, is, states));
+    }
+
+    Options["Thread Placement"] = saved;
+
+    cerr << "\n===========================";
+    for (const auto& r : results)
+        cerr << "\n" << r.first << string(16 - r.first.size(), ' ') << ": " << r.second << " nps"
+             << " (" << showpos << fixed << setprecision(1)
+             << (100.0 * r.second / results[0].second - 100) << noshowpos << "%)";
+    cerr << endl;
+  }
+
+  // tbbench() is called when engine receives the "tbbench" command. It probes
+  // the WDL tables on a fixed set of endgame positions, first without and then
+  // with the per-thread block cache, and reports the probe rate of both runs.
+
+  void tbbench(istream& args) {
+
+    static const char* Fens[] = {
+      "8/8/8/4k3/8/8/3KP3/8 w - - 0 1",
+      "8/8/4k3/8/8/3K4/3R4/8 w - - 0 1",
+      "8/2k5/8/8/3B4/8/3KN3/8 w - - 0 1",
+      "8/8/8/3k4/8/2Q5/4K3/5q2 w - - 0 1",
+      "8/8/1k6/8/8/3K4/4RP2/4r3 w - - 0 1",
+      "8/8/3k4/3p4/8/3PK3/8/8 w - - 0 1",
+      "8/5k2/8/8/2b5/4K3/3NR3/8 w - - 0 1",
+      "8/p7/8/1k6/8/8/PP6/1K6 w - - 0 1",
+      "6k1/8/8/4pK2/8/8/5R2/1r6 w - - 0 1",
+      "8/8/8/2k5/2p5/8/1PP5/1K6 b - - 0 1"
+    };
+
+    int rounds = 20;
+    args >> rounds;
+
+    if (!Tablebases::MaxCardinality)
+    {
+        sync_cout << "info string No tablebases loaded, set SyzygyPath first" << sync_endl;
+        return;
+    }
+
+    // Expand each root two plies deep, keeping what the tables can answer
+    std::deque<StateInfo> states;
+    vector<string> fens;
+
+    for (const char* f : Fens)
+    {
+        Position pos;
+        states.emplace_back();
+        pos.set(f, false, &states.back(), Threads.main());
+        fens.push_back(pos.fen());
+
+        for (const auto& m1 : MoveList<LEGAL>(pos))
+        {
+            states.emplace_back();
+            pos.do_move(m1, states.back());
+            fens.push_back(pos.fen());
+
+            for (const auto& m2 : MoveList<LEGAL>(pos))
+            {
+                states.emplace_back();
+                pos.do_move(m2, states.back());
+                fens.push_back(pos.fen());
+                pos.undo_move(m2);
+            }
+            pos.undo_move(m1);
+        }
+    }
+
+    std::deque<Position> positions;
+    states.clear();
+
+    for (const string& f : fens)
+    {
+        states.emplace_back();
+        positions.emplace_back();
+        positions.back().set(f, false, &states.back(), Threads.main());
+        if (popcount(positions.back().pieces()) > Tablebases::MaxCardinality)
+            positions.pop_back();
+    }
+
+    Tablebases::BlockCache& cache = Threads.main()->tbCache;
+    size_t cacheMB = size_t(Options["SyzygyBlockCache"]);
+
+    for (size_t mb : { size_t(0), std::max(cacheMB, size_t(16)) })
+    {
+        cache.resize(mb);
+
+        uint64_t probes = 0, failed = 0;
+        int64_t elapsed = now_us();
+
+        for (int r = 0; r < rounds; ++r)
+            for (Position& pos : positions)
+            {
+                Tablebases::ProbeState result;
+                Tablebases::probe_wdl(pos, &result);
+                failed += (result == Tablebases::FAIL);
+                ++probes;
+            }
+
+        elapsed = now_us() - elapsed + 1;
+
+        sync_cout << "Block cache (MB)   : " << mb
+                  << "\nPositions          : " << positions.size()
+                  << "\nProbes             : " << probes << " (" << failed << " failed)"
+                  << "\nProbes/second      : " << 1000000 * probes / elapsed
+                  << "\nCache hit rate (%) : "
+                  << (cache.hits + cache.misses ? 100 * cache.hits / (cache.hits + cache.misses) : 0)
+                  << "\n" << sync_endl;
+    }
+
+    cache.resize(cacheMB);
+  }
+
+  // quantcheck() is called when engine receives the "quantcheck" command. It
+  // compares the NNUE evaluation with int8 feature transformer weights to the
+  // one with int16 weights, on the FENs of a file, one per line, or by default
+  // on the bench positions and the positions one move after them.
+
+  void quantcheck(Position& pos, istream& args) {
+
+    if (!Eval::useNNUE)
+    {
+        sync_cout << "info string NNUE evaluation is disabled" << sync_endl;
+        return;
+    }
+
+    vector<pair<string, bool>> fens; // With the Chess960 flag
+    string file, line;
+
+    if (args >> file)
+    {
+        ifstream in(file);
+        while (getline(in, line))
+            if (!line.empty())
+                fens.emplace_back(line, bool(Options["UCI_Chess960"]));
+    }
+    else
+    {
+        istringstream is("16 1 1 default depth");
+        bool chess960 = false;
+
+        for (const string& cmd : setup_bench(pos, is))
+        {
+            if (cmd.find("UCI_Chess960") != string::npos)
+                chess960 = cmd.find("value true") != string::npos;
+
+            if (cmd.find("position fen ") != 0)
+                continue;
+
+            StateInfo st, st2;
+            Position p;
+            p.set(cmd.substr(13), chess960, &st, Threads.main());
+            fens.emplace_back(p.fen(), chess960);
+
+            for (const auto& m : MoveList<LEGAL>(p))
+            {
+                p.do_move(m, st2);
+                fens.emplace_back(p.fen(), chess960);
+                p.undo_move(m);
+            }
+        }
+    }
+
+    if (fens.empty())
+    {
+        sync_cout << "info string No position to compare" << sync_endl;
+        return;
+    }
+
+    // Every evaluation refreshes the accumulator, as the position has no parent
+    auto evaluate_all = [&](vector<Value>& values) {
+        int64_t elapsed = now_us();
+        for (const auto& [fen, chess960] : fens)
+        {
+            StateInfo st;
+            Position p;
+            p.set(fen, chess960, &st, Threads.main());
+            values.push_back(Eval::NNUE::evaluate(p));
+        }
+        return double(now_us() - elapsed + 1) * 1000 / fens.size();
+    };
+
+    vector<Value> ref, quant;
+    Eval::NNUE::set_int8(false);
+    double refNs = evaluate_all(ref);
+    Eval::NNUE::set_int8(true);
+    double quantNs = evaluate_all(quant);
+    Eval::NNUE::set_int8(Options["NNUE Int8 Weights"]);
+
+    double sumDiff = 0;
+    int maxDiff = 0, over10 = 0, signChanges = 0;
+    size_t worst = 0;
+
+    for (size_t i = 0; i < fens.size(); ++i)
+    {
+        int diff = std::abs(quant[i] - ref[i]) * 100 / PawnValueEg; // Centipawns
+        sumDiff += diff;
+        over10 += diff > 10;
+        signChanges += (ref[i] > 0 && quant[i] < 0) || (ref[i] < 0 && quant[i] > 0);
+
+        if (diff > maxDiff)
+            maxDiff = diff, worst = i;
+    }
+
+    sync_cout << "Positions          : " << fens.size()
+              << "\nMean |diff| (cp)   : " << fixed << setprecision(2) << sumDiff / fens.size()
+              << "\nMax |diff| (cp)    : " << maxDiff << " (" << fens[worst].first << ")"
+              << "\nOver 10 cp         : " << over10 << " (" << setprecision(1) << 100.0 * over10 / fens.size() << "%)"
+              << "\nSign changes       : " << signChanges
+              << "\nRefresh int16 (ns) : " << setprecision(0) << refNs
+              << "\nRefresh int8 (ns)  : " << quantNs << sync_endl;
   }
 
   // The win rate model returns the probability (per mille) of winning given an eval
@@ -246,8 +545,16 @@ void UCI::loop(int argc, char* argv[]) {
   for (int i = 1; i < argc; ++i)
       cmd += std::string(argv[i]) + " ";
 
+  // A cluster worker takes its commands from the master instead of stdin
+  bool worker = argc > 2 && std::string(argv[1]) == "cluster";
+  if (worker && !Cluster::serve(argc - 2, argv + 2))
+      return;
+
   do {
-      if (argc == 1 && !getline(cin, cmd)) // Block here waiting for input or EOF
+      if (worker)
+          cmd = Cluster::next_command();
+
+      else if (argc == 1 && !getline(cin, cmd)) // Block here waiting for input or EOF
           cmd = "quit";
 
       istringstream is(cmd);
@@ -264,7 +571,7 @@ void UCI::loop(int argc, char* argv[]) {
       // user has played. We should continue searching but switch from pondering to
       // normal search.
       else if (token == "ponderhit")
-          Threads.main()->ponder = false; // Switch to normal search
+          Threads.ponderhit(); // Switch to normal search
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
@@ -274,7 +581,7 @@ void UCI::loop(int argc, char* argv[]) {
       else if (token == "setoption")  setoption(is);
       else if (token == "go")         go(pos, is, states);
       else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
+      else if (token == "ucinewgame") { Cluster::forward(cmd); Search::clear(); }
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
 
       // Additional custom non-UCI commands, mainly for debugging.
@@ -284,8 +591,25 @@ void UCI::loop(int argc, char* argv[]) {
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     trace_eval(pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "evalstats") sync_cout << Eval::hybrid_stats() << sync_endl;
+      else if (token == "startstats") sync_cout << Threads.start_stats() << sync_endl;
+      else if (token == "stats")
+      {
+          is >> token;
+          sync_cout << Telemetry::snapshot(token == "json" ? Telemetry::JSON : Telemetry::Prometheus) << sync_endl;
+      }
+      else if (token == "memory")
+      {
+          string report = Memory::report(); // May wait for the experience, so not under the output lock
+          sync_cout << report << sync_endl;
+      }
+      else if (token == "tbbench")  tbbench(is);
+      else if (token == "quantcheck") quantcheck(pos, is);
+      else if (token == "placebench") placebench(pos, is, states);
       else if (argc > 2 && token == "defrag")   Experience::defrag(argc - 2, argv + 2);
       else if (argc > 2 && token == "merge")    Experience::merge(argc - 2, argv + 2);
+      else if (argc > 2 && token == "expstats") Experience::stats(argc - 2, argv + 2);
+      else if (argc > 2 && token == "expbench") Experience::bench(argc - 2, argv + 2);
       else if (token == "exp")                  Experience::show_exp(pos, false);
       else if (token == "expex")                Experience::show_exp(pos, true);
       else if (argc > 2 && token == "convert_compact_pgn") Experience::convert_compact_pgn(argc - 2, argv + 2);
@@ -300,7 +624,7 @@ void UCI::loop(int argc, char* argv[]) {
       else if (!token.empty() && token[0] != '#')
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
-  } while (token != "quit" && argc == 1); // Command line args are one-shot
+  } while (token != "quit" && (argc == 1 || worker)); // Command line args are one-shot
 }
 
 
@@ -21,9 +21,12 @@
 #include <ostream>
 #include <sstream>
 
+#include "cluster.h"
 #include "evaluate.h"
+#include "memory.h"
 #include "misc.h"
 #include "search.h"
+#include "telemetry.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
@@ -41,16 +44,25 @@ namespace UCI {
 
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_hash_size(const Option&) { Memory::resize_hash(); }
+void on_memory(const Option&) { Memory::apply(); }
+void on_stats(const Option&) { Telemetry::init(); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_spin_wait(const Option& o) { Threads.spinWait = int(o); }
+void on_thread_placement(const Option& o) { CpuPlacement::set_policy(o); Threads.rebind(); }
+void on_cluster_workers(const Option& o) { Cluster::init(o); }
+void on_cluster_min_depth(const Option& o) { Cluster::set_min_depth(o); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_manifest(const Option&) { Tablebases::init(Options["SyzygyPath"]); }
+void on_tb_block_cache(const Option& o) { for (Thread* th : Threads) th->tbCache.resize(size_t(o)); }
 void on_book1_file(const Option& o) { polybook[0].init(o); }
 void on_book2_file(const Option& o) { polybook[1].init(o); }
 void on_exp_enabled(const Option& /*o*/) { Experience::init(); }
 void on_exp_file(const Option& /*o*/) { Experience::init(); }
 void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
 void on_eval_file(const Option& ) { Eval::NNUE::init(); }
+void on_nnue_int8(const Option& o) { Eval::NNUE::set_int8(o); }
 
 /// Our case insensitive less() function as required by UCI protocol
 bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const {
@@ -70,24 +82,39 @@ void init(OptionsMap& o) {
   o["Contempt"]                        << Option(24, -100, 100);
   o["Analysis Contempt"]               << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]                         << Option(1, 1, 512, on_threads);
+  o["Spin Wait"]                       << Option(0, 0, 10000, on_spin_wait);
+  o["Thread Placement"]                << Option("None var None var Cores var Siblings", "None", on_thread_placement);
+  o["Perf Counters"]                   << Option(false);
+  o["Cluster Workers"]                 << Option("<empty>", on_cluster_workers);
+  o["Cluster Min Depth"]               << Option(8, 1, MAX_PLY, on_cluster_min_depth);
   o["Hash"]                            << Option(16, 1, MaxHashMB, on_hash_size);
+  o["Memory Budget"]                   << Option(0, 0, MaxHashMB, on_memory);
+  o["Memory Policy"]                   << Option("Hash var Hash var Experience", "Hash", on_memory);
   o["Clear Hash"]                      << Option(on_clear_hash);
   o["Ponder"]                          << Option(false);
+  o["Ponder Candidates"]               << Option(1, 1, 8);
   o["MultiPV"]                         << Option(1, 1, 500);
   o["Skill Level"]                     << Option(20, 0, 20);
   o["Move Overhead"]                   << Option(10, 0, 5000);
+  o["Auto Move Overhead"]              << Option(false);
   o["Minimum Thinking Time"]           << Option(5, 0, 5000);
   o["Slow Mover"]                      << Option(100, 10, 1000);
   o["nodestime"]                       << Option(0, 0, 10000);
+  o["NPS Time Management"]             << Option(false);
   o["UCI_Chess960"]                    << Option(false);
   o["UCI_AnalyseMode"]                 << Option(false);
   o["UCI_LimitStrength"]               << Option(false);
   o["UCI_Elo"]                         << Option(1350, 1350, 2850);
   o["UCI_ShowWDL"]                     << Option(false);
   o["SyzygyPath"]                      << Option("<empty>", on_tb_path);
+  o["SyzygyManifest"]                  << Option("<empty>", on_tb_manifest);
   o["SyzygyProbeDepth"]                << Option(1, 1, 100);
   o["Syzygy50MoveRule"]                << Option(true);
   o["SyzygyProbeLimit"]                << Option(7, 0, 7);
+  o["SyzygyBlockCache"]                << Option(0, 0, 1024, on_tb_block_cache);
+  o["Stats File"]                      << Option("<empty>", on_stats);
+  o["Stats Format"]                    << Option("Prometheus var Prometheus var JSON", "Prometheus", on_stats);
+  o["Stats Interval"]                  << Option(1000, 100, 3600000, on_stats);
   o["Book1"]                           << Option(false);
   o["Book1 File"]                      << Option("<empty>", on_book1_file);
   o["Book1 BestBookMove"]              << Option(true);
@@ -99,13 +126,22 @@ void init(OptionsMap& o) {
   o["Experience Enabled"]              << Option(true, on_exp_enabled);
   o["Experience File"]                 << Option("SugaR.exp", on_exp_file);
   o["Experience Readonly"]             << Option(false);
+  o["Experience Shared"]               << Option(false, on_exp_file);
+  o["Experience Min Depth"]            << Option(EXP_MIN_DEPTH, EXP_MIN_DEPTH, MAX_PLY);
+  o["Experience Min Count"]            << Option(1, 1, 1000);
+  o["Experience Max Moves"]            << Option(0, 0, 256);
+  o["Experience Max Size"]             << Option(0, 0, 1048576);
+  o["Experience Preload Plies"]        << Option(0, 0, 32);
   o["Experience Book"]                 << Option(false);
   o["Experience Book Best Move"]       << Option(true);
   o["Experience Book Eval Importance"] << Option(5, 0, 10);
   o["Experience Book Max Moves"]       << Option(16, 1, 100);
   o["EvalFile"]                        << Option(EvalFileDefaultName, on_eval_file);
+  o["EvalFileSmall"]                   << Option(EvalFileSmallDefaultName, on_eval_file);
   o["Use NNUE Evaluation"]             << Option(true, on_use_NNUE);
+  o["NNUE Int8 Weights"]               << Option(false, on_nnue_int8);
   o["Use Classical Evaluation"]        << Option(true);
+  o["Hybrid Eval Cache"]               << Option(false);
 }
 
 
@@ -0,0 +1,49 @@
+#!/bin/bash
+# verify that a cluster works on one machine: a worker listening on a Unix
+# socket helps a master, and its votes are counted.
+
+error()
+{
+  echo "cluster testing failed on line $1"
+  kill $worker 2>/dev/null || true
+  rm -f $socket
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "cluster testing started"
+
+socket=/tmp/sugar-cluster-$$.sock
+
+./sugar cluster unix:$socket 1 16 > /dev/null 2>&1 &
+worker=$!
+
+# wait for the worker to listen
+for i in `seq 1 50`
+do
+  [ -S $socket ] && break
+  sleep 0.1
+done
+
+# a clock and a fixed depth: the votes are waited for a short time with the
+# first and up to the timeout with the second, so both must come back.
+output=$( (echo "setoption name Cluster Workers value unix:$socket"
+           echo "isready"
+           sleep 1
+           echo "position startpos moves e2e4"
+           echo "go wtime 10000 btime 10000"
+           sleep 2
+           echo "position startpos moves d2d4"
+           echo "go depth 10"
+           sleep 3
+           echo "quit") | ./sugar 2>&1)
+
+echo "$output" | grep "Cluster:"
+
+# each search got the vote of the worker
+test `echo "$output" | grep -c "Cluster: 1 votes"` -eq 2
+
+wait $worker
+rm -f $socket
+
+echo "cluster testing OK"